@@ -0,0 +1,94 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "shell_core.h"
+
+#define MAX_BUILTINS 256
+#define MAX_SEED_TRIES 1000000
+
+// One line of shell_builtins.def
+typedef struct {
+    char name[64];
+    char function[64];
+    char level[64];
+    char flags[64];
+} BuiltinDef;
+
+// Reads the builtin list and prints shell_builtins.h: a table indexed by
+// builtin_hash(name, seed) & (size - 1), with a seed chosen so that no two
+// names share a slot. Entries are wrapped in SHELL_LEVEL checks, so one table
+// layout serves every shell.
+int main(int argc, char* argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s shell_builtins.def > shell_builtins.h\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    FILE* in = fopen(argv[1], "r");
+    if (in == NULL) {
+        perror("Error opening builtin list");
+        return EXIT_FAILURE;
+    }
+
+    BuiltinDef defs[MAX_BUILTINS];
+    int count = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), in) != NULL) {
+        if (line[0] == '#' || strspn(line, DELIMITERS) == strlen(line)) {
+            continue;
+        }
+        if (count == MAX_BUILTINS) {
+            fprintf(stderr, "Too many builtins\n");
+            fclose(in);
+            return EXIT_FAILURE;
+        }
+        strcpy(defs[count].flags, "0");
+        if (sscanf(line, "%63s %63s %63s %63s", defs[count].name, defs[count].function, defs[count].level,
+                   defs[count].flags) < 3) {
+            fprintf(stderr, "Invalid line: %s", line);
+            fclose(in);
+            return EXIT_FAILURE;
+        }
+        count++;
+    }
+    fclose(in);
+
+    // Keep the table at most half full so a collision-free seed is quick to find
+    uint32_t size = 1;
+    while (size < 2 * (uint32_t)count) {
+        size *= 2;
+    }
+    int slots[2 * MAX_BUILTINS];
+    uint32_t seed;
+    for (seed = 0; seed < MAX_SEED_TRIES; seed++) {
+        int collision = 0;
+        memset(slots, -1, sizeof(int) * size);
+        for (int i = 0; i < count && !collision; i++) {
+            uint32_t slot = builtin_hash(defs[i].name, seed) & (size - 1);
+            collision = (slots[slot] != -1);
+            slots[slot] = i;
+        }
+        if (!collision) {
+            break;
+        }
+    }
+    if (seed == MAX_SEED_TRIES) {
+        fprintf(stderr, "No perfect hash seed found\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("// Generated by gen_builtins from %s. Do not edit.\n", argv[1]);
+    printf("#define BUILTIN_HASH_SEED %uu\n", seed);
+    printf("#define BUILTIN_TABLE_SIZE %u\n\n", size);
+    printf("static const BuiltinSlot builtin_table[BUILTIN_TABLE_SIZE] = {\n");
+    for (uint32_t slot = 0; slot < size; slot++) {
+        if (slots[slot] == -1) {
+            continue;
+        }
+        BuiltinDef* def = &defs[slots[slot]];
+        printf("#if SHELL_LEVEL >= %s\n", def->level);
+        printf("    [%u] = {\"%s\", %s, %s},\n", slot, def->name, def->function, def->flags);
+        printf("#endif\n");
+    }
+    printf("};\n");
+    return EXIT_SUCCESS;
+}
@@ -1,415 +1,2327 @@
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <unistd.h>
-#include <sys/wait.h>
-#include <errno.h>
-#include <fcntl.h>
-
-#define MAX_INPUT 256
-#define MAX_ARGS 64
-#define DELIMITERS " \t\r\n"
-
-// Structure to store shell variables
-typedef struct {
-    char* name;
-    char* value;
-} ShellVar;
-
-// Global array to store shell variables
-ShellVar* shellVars = NULL;
-int numShellVars = 0;
-int maxShellVars = 0;
-
-// Structure to hold redirection information
-typedef struct {
-    char* input_file;
-    char* output_file;
-    char* error_file;
-} RedirectionInfo;
-
-// Function prototypes
-char** parse_input(char* input, int* argc, RedirectionInfo* redir_info);
-void execute_command(char** argv, int argc, RedirectionInfo* redir_info);
-int execute_builtin(char** argv, int argc);
-void free_arguments(char** argv, int argc);
-void add_shell_var(const char* name, const char* value);
-char* get_shell_var(const char* name);
-void free_shell_vars();
-char* substitute_variables(char* input);
-int is_valid_assignment(const char* input);
-void export_variable(const char* name);
-void free_redirection_info(RedirectionInfo* redir_info);
-
-int main() {
-    char input[MAX_INPUT];
-
-    printf("Welcome to Nano Shell! Type 'exit' to quit.\n");
-
-    while (1) {
-        printf("Nano Shell Prompt > ");
-        if (fgets(input, MAX_INPUT, stdin) == NULL) {
-            printf("\nGood Bye :)\n");
-            break;
-        }
-
-        // Remove trailing newline
-        input[strcspn(input, "\n")] = '\0';
-
-        // Check for variable assignment
-        if (strchr(input, '=') != NULL) {
-            if (is_valid_assignment(input)) {
-                char* eq_ptr = strchr(input, '=');
-                *eq_ptr = '\0';
-                add_shell_var(input, eq_ptr + 1);
-            } else {
-                fprintf(stderr, "Invalid command\n");
-            }
-            continue;
-        }
-
-        char* substituted_input = substitute_variables(input);
-        int argc;
-        RedirectionInfo redir_info = {NULL, NULL, NULL};
-        char** argv = parse_input(substituted_input, &argc, &redir_info);
-        free(substituted_input);
-
-        if (argc > 0) {
-            if (execute_builtin(argv, argc) == 0) {
-                execute_command(argv, argc, &redir_info);
-            }
-        }
-        free_arguments(argv, argc);
-        free_redirection_info(&redir_info);
-    }
-
-    free_shell_vars();
-    return EXIT_SUCCESS;
-}
-
-char** parse_input(char* input, int* argc, RedirectionInfo* redir_info) {
-    char** argv = (char**)malloc(sizeof(char*) * MAX_ARGS);
-    if (argv == NULL) {
-        perror("malloc failed");
-        exit(EXIT_FAILURE);
-    }
-
-    char* token = strtok(input, DELIMITERS);
-    *argc = 0;
-    int redirection_mode = 0; // 0: normal, 1: input, 2: output, 3: error
-
-    while (token != NULL) {
-        if (strcmp(token, "<") == 0) {
-            redirection_mode = 1;
-        } else if (strcmp(token, ">") == 0) {
-            redirection_mode = 2;
-        } else if (strcmp(token, "2>") == 0) {
-            redirection_mode = 3;
-        } else if (redirection_mode == 1) {
-            redir_info->input_file = strdup(token);
-            redirection_mode = 0;
-        } else if (redirection_mode == 2) {
-            redir_info->output_file = strdup(token);
-            redirection_mode = 0;
-        } else if (redirection_mode == 3) {
-            redir_info->error_file = strdup(token);
-            redirection_mode = 0;
-        } else {
-            argv[*argc] = (char*)malloc(sizeof(char) * (strlen(token) + 1));
-            if (argv[*argc] == NULL) {
-                perror("malloc failed");
-                // Free previously allocated memory
-                for (int i = 0; i < *argc; i++) {
-                    free(argv[i]);
-                }
-                free(argv);
-                exit(EXIT_FAILURE);
-            }
-            strcpy(argv[*argc], token);
-            (*argc)++;
-
-            if (*argc >= MAX_ARGS) {
-                fprintf(stderr, "Too many arguments\n");
-                break;
-            }
-        }
-
-        token = strtok(NULL, DELIMITERS);
-    }
-    argv[*argc] = NULL;
-    return argv;
-}
-
-int execute_builtin(char** argv, int argc) {
-    if (strcmp(argv[0], "exit") == 0) {
-        printf("Good Bye :)\n");
-        exit(EXIT_SUCCESS);
-    } else if (strcmp(argv[0], "echo") == 0) {
-        for (int i = 1; i < argc; i++) {
-            printf("%s ", argv[i]);
-        }
-        printf("\n");
-        return 1;
-    } else if (strcmp(argv[0], "pwd") == 0) {
-        char cwd[1024];
-        if (getcwd(cwd, sizeof(cwd)) != NULL) {
-            printf("%s\n", cwd);
-        } else {
-            perror("getcwd error");
-        }
-        return 1;
-    } else if (strcmp(argv[0], "cd") == 0) {
-        if (argc > 2) {
-            fprintf(stderr, "cd: too many arguments\n");
-        } else {
-            char* dir = (argc == 1) ? getenv("HOME") : argv[1];
-            if (chdir(dir) != 0) {
-                perror("chdir error");
-            }
-        }
-        return 1;
-    } else if (strcmp(argv[0], "export") == 0) {
-        if (argc != 2) {
-            fprintf(stderr, "export: invalid number of arguments\n");
-        } else {
-            export_variable(argv[1]);
-        }
-        return 1;
-    }
-    else if (strcmp(argv[0], "printenv") == 0)
-    {
-        extern char** environ;
-        for (char** env = environ; *env != 0; env++)
-        {
-            char* thisEnv = *env;
-            printf("%s\n", thisEnv);
-        }
-        return 1;
-    }
-    return 0; // Not a built-in command
-}
-
-void execute_command(char** argv, int argc, RedirectionInfo* redir_info) {
-    pid_t pid = fork();
-    if (pid == -1) {
-        perror("fork failed");
-        return;
-    } else if (pid == 0) {
-        // Child process
-        int fd_in_dup = -1;
-        int fd_out_dup = -1;
-        int fd_err_dup = -1;
-        // Handle input redirection
-        if (redir_info->input_file != NULL) {
-            int fd_in = open(redir_info->input_file, O_RDONLY);
-            if (fd_in == -1) {
-                perror("open input file failed");
-                exit(EXIT_FAILURE);
-            }
-            fd_in_dup = dup(0); // Duplicate stdin
-            if (fd_in_dup == -1) {
-                perror("dup input failed");
-                close(fd_in);
-                exit(EXIT_FAILURE);
-            }
-            if (dup2(fd_in, 0) == -1) {
-                perror("dup2 input failed");
-                close(fd_in);
-                exit(EXIT_FAILURE);
-            }
-            close(fd_in);
-        }
-
-        // Handle output redirection
-        if (redir_info->output_file != NULL) {
-            int fd_out = open(redir_info->output_file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-            if (fd_out == -1) {
-                perror("open output file failed");
-                exit(EXIT_FAILURE);
-            }
-            fd_out_dup = dup(1); // Duplicate stdout
-            if (fd_out_dup == -1) {
-                perror("dup output failed");
-                close(fd_out);
-                exit(EXIT_FAILURE);
-            }
-            if (dup2(fd_out, 1) == -1) {
-                perror("dup2 output failed");
-                close(fd_out);
-                exit(EXIT_FAILURE);
-            }
-            close(fd_out);
-        }
-
-        // Handle error redirection
-        if (redir_info->error_file != NULL) {
-            int fd_err = open(redir_info->error_file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-            if (fd_err == -1) {
-                perror("open error file failed");
-                exit(EXIT_FAILURE);
-            }
-            fd_err_dup = dup(2); // Duplicate stderr
-            if (fd_err_dup == -1) {
-                perror("dup error failed");
-                close(fd_err);
-                exit(EXIT_FAILURE);
-            }
-            if (dup2(fd_err, 2) == -1) {
-                perror("dup2 error failed");
-                close(fd_err);
-                exit(EXIT_FAILURE);
-            }
-            close(fd_err);
-        }
-
-        execvp(argv[0], argv);
-
-        // If execvp returns, there was an error
-        perror("execvp failed");
-        
-        // Restore file descriptors if needed
-        if (fd_in_dup != -1) {
-            dup2(fd_in_dup, 0);
-            close(fd_in_dup);
-        }
-        if (fd_out_dup != -1) {
-            dup2(fd_out_dup, 1);
-            close(fd_out_dup);
-        }
-        if (fd_err_dup != -1) {
-            dup2(fd_err_dup, 2);
-            close(fd_err_dup);
-        }
-        exit(EXIT_FAILURE);
-    } else {
-        // Parent process
-        int status;
-        if (waitpid(pid, &status, 0) == -1) {
-            perror("waitpid failed");
-            return;
-        }
-        if (WIFEXITED(status)) {
-            if (WEXITSTATUS(status) != 0) {
-                fprintf(stderr, "command failed\n");
-            }
-        }
-    }
-}
-
-void free_arguments(char** argv, int argc) {
-    for (int i = 0; i < argc; i++) {
-        free(argv[i]);
-    }
-    free(argv);
-}
-
-void add_shell_var(const char* name, const char* value) {
-    // Resize the array if needed
-    if (numShellVars == maxShellVars) {
-        maxShellVars = (maxShellVars == 0) ? 1 : maxShellVars * 2;
-        ShellVar* newShellVars = (ShellVar*)realloc(shellVars, sizeof(ShellVar) * maxShellVars);
-        if (newShellVars == NULL) {
-            perror("realloc failed");
-            exit(EXIT_FAILURE);
-        }
-        shellVars = newShellVars;
-    }
-
-    // Allocate memory for the name and value
-    shellVars[numShellVars].name = strdup(name);
-    shellVars[numShellVars].value = strdup(value);
-    if (shellVars[numShellVars].name == NULL || shellVars[numShellVars].value == NULL) {
-        perror("strdup failed");
-        exit(EXIT_FAILURE);
-    }
-
-    numShellVars++;
-}
-
-char* get_shell_var(const char* name) {
-    for (int i = 0; i < numShellVars; i++) {
-        if (strcmp(shellVars[i].name, name) == 0) {
-            return shellVars[i].value;
-        }
-    }
-    return NULL;
-}
-
-void free_shell_vars() {
-    for (int i = 0; i < numShellVars; i++) {
-        free(shellVars[i].name);
-        free(shellVars[i].value);
-    }
-    free(shellVars);
-}
-
-char* substitute_variables(char* input) {
-    char* result = (char*)malloc(strlen(input) * 2 + 1); // Allocate enough space
-    if (result == NULL) {
-        perror("malloc failed");
-        exit(EXIT_FAILURE);
-    }
-    int result_index = 0;
-    int i = 0;
-    while (input[i] != '\0') {
-        if (input[i] == '$') {
-            i++;
-            char var_name[MAX_INPUT];
-            int j = 0;
-            while (input[i] != '\0' && input[i] != ' ' && input[i] != '\t' && input[i] != '\n' && input[i] != '\r') {
-                var_name[j++] = input[i++];
-            }
-            var_name[j] = '\0';
-            char* var_value = get_shell_var(var_name);
-            if (var_value != NULL) {
-                strcpy(result + result_index, var_value);
-                result_index += strlen(var_value);
-            }
-        } else {
-            result[result_index++] = input[i++];
-        }
-    }
-    result[result_index] = '\0';
-    return result;
-}
-
-int is_valid_assignment(const char* input) {
-    const char* eq_ptr = strchr(input, '=');
-    if (eq_ptr == NULL) {
-        return 0;
-    }
-    if (strchr(eq_ptr + 1, '=') != NULL)
-    {
-        return 0;
-    }
-    if (strchr(input,' ') != NULL || strchr(input,'\t') != NULL)
-    {
-        if (strchr(input,' ') < eq_ptr || strchr(input,'\t') < eq_ptr)
-        {
-            return 0;
-        }
-    }
-    
-    return 1;
-}
-void export_variable(const char* name) {
-    char* value = get_shell_var(name);
-    if (value != NULL) {
-        if (setenv(name, value, 1) != 0) {
-            perror("setenv failed");
-        }
-    } else {
-        fprintf(stderr, "export: variable not found\n");
-    }
-}
-void free_redirection_info(RedirectionInfo* redir_info) {
-    if (redir_info->input_file != NULL) {
-        free(redir_info->input_file);
-    }
-    if (redir_info->output_file != NULL) {
-        free(redir_info->output_file);
-    }
-    if (redir_info->error_file != NULL) {
-        free(redir_info->error_file);
-    }
-}
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <signal.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/signalfd.h>
+#include <sys/resource.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <termios.h>
+#include <dirent.h>
+#include <sys/syscall.h>
+#include "shell_core.h"
+
+#define PARALLEL_READ_CHUNK 4096
+#define PARALLEL_MAX_FAILED 101
+#define PARALLEL_MAX_JOBS 1024 // upper bound on -j, far above any useful fan-out
+#define CACHE_MAGIC 0x31434d53 // "SMC1"
+#define CACHE_DIR_NAME ".micro_shell_cache"
+#define CACHE_DEFAULT_MAX_BYTES (64L * 1024 * 1024)
+#define CACHE_INPUT_KNOWN 0
+#define CACHE_INPUT_NONE 1
+#define CACHE_INPUT_UNKNOWN 2
+#define CACHE_DEFAULT_ENV "PATH"
+#define SERVER_DEFAULT_HELPERS 4
+#define SERVER_BACKLOG 128
+#define SERVER_MAX_REQUEST (1024 * 1024)
+#define TRIE_SHARED_DIR 63 // PATH directories from this index on share one bit of TrieNode.dirs
+#define COMPLETION_MAX_SHOW 100
+#define INOTIFY_BUFFER_SIZE 65536
+#define HISTORY_FILE_NAME ".micro_shell_history"
+#define ESCAPE_TIMEOUT_MS 50 // the rest of a key's escape sequence arrives within this
+
+// State of one job started by the parallel builtin
+typedef struct {
+    pid_t pid;
+    int fd;         // read end of the job's stdout/stderr pipe, -1 once drained
+    char* output;   // buffered output, flushed in input order
+    size_t length;
+    size_t capacity;
+    int done;
+    int status;
+} ParallelJob;
+
+// Header of a cache entry. It is followed by the key it was stored under
+// (checked on every hit) and the command's stdout and stderr.
+typedef struct {
+    uint32_t magic;
+    int32_t status;
+    uint64_t key_length;
+    uint64_t out_length;
+    uint64_t err_length;
+} CacheHeader;
+
+// A cache entry seen while enforcing the size cap
+typedef struct {
+    char* name;
+    struct timespec used; // mtime, refreshed on every hit
+    off_t size;
+} CacheEntry;
+
+// Node of the command-name trie, stored in one growable array and linked by
+// index (first child / next sibling, siblings sorted by character)
+typedef struct {
+    int child;     // first child, 0 when none
+    int sibling;   // next sibling, 0 when none
+    uint64_t dirs; // bit i set while PATH directory i (or, for the last bit,
+                   // one of the directories from TRIE_SHARED_DIR on) holds this name
+    char c;
+} TrieNode;
+
+// Command names found in PATH. Built once, then kept current from inotify
+// events instead of rescanning the directories.
+typedef struct {
+    TrieNode* nodes; // nodes[0] is the root
+    int num_nodes;
+    int max_nodes;
+    char* path;      // PATH value the trie was built from
+    int inotify_fd;
+    char* dir_list;  // copy of path, split in place into dirs
+    char** dirs;     // each PATH directory
+    int* watches;    // watch descriptor of each PATH directory
+    int num_dirs;
+    int max_dirs;
+} CommandTrie;
+
+// Completion candidates for the word under the cursor
+typedef struct {
+    char** items;
+    int count;
+    int capacity;
+} CompletionList;
+
+// One history entry: a line of the mapped file (not NUL-terminated) or a
+// session entry
+typedef struct {
+    const char* text;
+    size_t length;
+} HistoryLine;
+
+// Persistent command history. The file written by earlier sessions is mapped
+// read-only at startup, so loading costs no parsing pass however large it is;
+// entries from this session are appended to the file and kept in memory. The
+// index of all entries is built on the first Up or Ctrl-R and extended by
+// every new entry after that.
+typedef struct {
+    char* map;      // history file as it was at startup
+    size_t map_size;
+    int fd;         // O_APPEND descriptor for new entries, -1 when disabled
+    char** session; // entries added since startup, oldest first
+    int num_session;
+    int max_session;
+    HistoryLine* lines; // mapped lines then session entries, oldest first
+    int num_lines;
+    int max_lines;
+    int indexed;        // lines is built
+} History;
+
+// Position while walking the history: an index into History.lines, or -1 on
+// the line being edited, which is newer than every entry.
+typedef struct {
+    int line;
+} HistoryCursor;
+
+// Fixed-size header of a server request. It is followed by `length` bytes
+// holding the cwd, the argv strings and the env strings, each NUL-terminated.
+// The client's stdin, stdout and stderr travel with it as SCM_RIGHTS.
+typedef struct {
+    uint32_t argc;
+    uint32_t envc;
+    uint32_t length;
+} ServerRequest;
+
+// A helper that took a request, and the client connection awaiting its status
+typedef struct {
+    pid_t pid;
+    int conn_fd;
+} ServerJob;
+
+CommandTrie command_trie = {NULL, 0, 0, NULL, -1, NULL, NULL, NULL, 0, 0};
+
+History history = {NULL, 0, -1, NULL, 0, 0, NULL, 0, 0, 0};
+
+// Size of the cache store as this shell last saw it, kept up to date on every
+// store so the directory is only rescanned once it may be over the cap; -1
+// until the first scan
+long cache_store_bytes = -1;
+
+// Allocation counter for --bench-parse, built only with -DMICRO_SHELL_ALLOC_COUNT
+// (make myMicroShell_bench). glibc lets a program interpose malloc, calloc and
+// realloc over its own __libc_* entry points, so every allocation in the
+// process is counted, libc's own included. Sanitizer builds keep their
+// allocator and report no count.
+#if defined(MICRO_SHELL_ALLOC_COUNT) && (!defined(__GLIBC__) || defined(__SANITIZE_ADDRESS__))
+#undef MICRO_SHELL_ALLOC_COUNT
+#endif
+#ifdef MICRO_SHELL_ALLOC_COUNT
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t count, size_t size);
+extern void* __libc_realloc(void* ptr, size_t size);
+
+unsigned long alloc_count = 0;
+
+void* malloc(size_t size) {
+    alloc_count++;
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) {
+    alloc_count++;
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* ptr, size_t size) {
+    alloc_count++;
+    return __libc_realloc(ptr, size);
+}
+#endif
+
+// Function prototypes
+char* read_line(const char* prompt, char* buf, int size);
+ssize_t read_terminal_continuation(char** line, size_t* capacity);
+void history_open();
+void history_add(const char* line);
+int server_main(const char* socket_path, int num_helpers);
+int client_run(const char* socket_path, char** argv);
+int client_bench(const char* socket_path, int iterations, char** argv);
+int parse_bench(const char* path, int iterations);
+
+#ifndef MICRO_SHELL_NO_MAIN
+int main(int shell_argc, char* shell_argv[]) {
+    char input[MAX_INPUT];
+
+    if (shell_argc >= 3 && strcmp(shell_argv[1], "--server") == 0) {
+        int num_helpers = (shell_argc >= 4) ? atoi(shell_argv[3]) : SERVER_DEFAULT_HELPERS;
+        return server_main(shell_argv[2], num_helpers > 0 ? num_helpers : SERVER_DEFAULT_HELPERS);
+    } else if (shell_argc >= 4 && strcmp(shell_argv[1], "--client") == 0) {
+        return client_run(shell_argv[2], shell_argv + 3);
+    } else if (shell_argc >= 5 && strcmp(shell_argv[1], "--bench") == 0) {
+        return client_bench(shell_argv[2], atoi(shell_argv[3]), shell_argv + 4);
+    } else if (shell_argc >= 3 && strcmp(shell_argv[1], "--bench-parse") == 0) {
+        return parse_bench(shell_argv[2], (shell_argc >= 4) ? atoi(shell_argv[3]) : 1000);
+    }
+
+    char* trace_path = getenv("MICRO_SHELL_TRACE");
+    if (trace_path != NULL && *trace_path != '\0') {
+        char* trace_argv[] = {"trace", trace_path, NULL};
+        builtin_trace(trace_argv, 2);
+    }
+
+    if (isatty(0)) {
+        history_open();
+        read_continuation_line = read_terminal_continuation;
+    }
+
+    printf("Welcome to Nano Shell! Type 'exit' to quit.\n");
+
+    while (1) {
+        if (read_line("Nano Shell Prompt > ", input, MAX_INPUT) == NULL) {
+            printf("\nGood Bye :)\n");
+            break;
+        }
+
+        // Remove trailing newline
+        input[strcspn(input, "\n")] = '\0';
+        history_add(input);
+
+        shell_execute_line(input);
+    }
+
+    free_shell_vars();
+    return EXIT_SUCCESS;
+}
+#endif
+
+// Builds the argv of one parallel job: every "{}" in the template is replaced
+// by the item, and the item is appended when the template has no "{}".
+char** parallel_job_argv(char** tmpl, int tmpl_argc, const char* item) {
+    char** argv = (char**)malloc(sizeof(char*) * (tmpl_argc + 2));
+    if (argv == NULL) {
+        perror("malloc failed");
+        exit(EXIT_FAILURE);
+    }
+    size_t item_len = strlen(item);
+    int used_placeholder = 0;
+    for (int i = 0; i < tmpl_argc; i++) {
+        size_t len = 0;
+        for (const char* p = tmpl[i]; *p != '\0'; p++) {
+            if (p[0] == '{' && p[1] == '}') {
+                len += item_len;
+                p++;
+            } else {
+                len++;
+            }
+        }
+        argv[i] = (char*)malloc(len + 1);
+        if (argv[i] == NULL) {
+            perror("malloc failed");
+            exit(EXIT_FAILURE);
+        }
+        char* out = argv[i];
+        for (const char* p = tmpl[i]; *p != '\0'; p++) {
+            if (p[0] == '{' && p[1] == '}') {
+                memcpy(out, item, item_len);
+                out += item_len;
+                used_placeholder = 1;
+                p++;
+            } else {
+                *out++ = *p;
+            }
+        }
+        *out = '\0';
+    }
+    int argc = tmpl_argc;
+    if (!used_placeholder) {
+        argv[argc] = strdup(item);
+        if (argv[argc] == NULL) {
+            perror("strdup failed");
+            exit(EXIT_FAILURE);
+        }
+        argc++;
+    }
+    argv[argc] = NULL;
+    return argv;
+}
+
+// Appends the items listed in a file (or stdin when path is NULL), one per line.
+// stdin is read through its own stream on fd 0, never the shell's buffered
+// stdin, and only when it was redirected or is a terminal: otherwise it holds
+// the rest of the script the shell is reading.
+int parallel_read_items(const char* path, char*** items, int* num_items, int* max_items) {
+    FILE* in;
+    if (path == NULL) {
+        if (!stdin_redirected && !isatty(0)) {
+            fprintf(stderr, "parallel: no items: give them with ::: or ::::, or redirect stdin\n");
+            return -1;
+        }
+        int fd = dup(0);
+        in = (fd == -1) ? NULL : fdopen(fd, "r");
+        if (in == NULL) {
+            perror("parallel: open input failed");
+            return -1;
+        }
+    } else {
+        in = fopen(path, "r");
+        if (in == NULL) {
+            perror("parallel: open input failed");
+            return -1;
+        }
+    }
+    char* line = NULL;
+    size_t line_cap = 0;
+    ssize_t line_len;
+    while ((line_len = getline(&line, &line_cap, in)) != -1) {
+        while (line_len > 0 && (line[line_len - 1] == '\n' || line[line_len - 1] == '\r')) {
+            line[--line_len] = '\0';
+        }
+        if (line_len == 0) {
+            continue;
+        }
+        if (*num_items == *max_items) {
+            *max_items = (*max_items == 0) ? 64 : *max_items * 2;
+            char** new_items = (char**)realloc(*items, sizeof(char*) * *max_items);
+            if (new_items == NULL) {
+                perror("realloc failed");
+                exit(EXIT_FAILURE);
+            }
+            *items = new_items;
+        }
+        (*items)[*num_items] = strdup(line);
+        if ((*items)[*num_items] == NULL) {
+            perror("strdup failed");
+            exit(EXIT_FAILURE);
+        }
+        (*num_items)++;
+    }
+    free(line);
+    fclose(in);
+    return 0;
+}
+
+// Forks one job with stdout and stderr captured through a pipe and stdin
+// detached, so concurrent jobs can neither interleave nor steal shell input.
+void parallel_start_job(ParallelJob* job, char** tmpl, int tmpl_argc, const char* item) {
+    int pipe_fds[2];
+    job->fd = -1;
+    job->pid = -1;
+    if (pipe2(pipe_fds, O_CLOEXEC) == -1) {
+        perror("parallel: pipe failed");
+        job->done = 1;
+        job->status = 1;
+        return;
+    }
+    char** argv = parallel_job_argv(tmpl, tmpl_argc, item);
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("parallel: fork failed");
+        close(pipe_fds[0]);
+        close(pipe_fds[1]);
+        job->done = 1;
+        job->status = 1;
+    } else if (pid == 0) {
+        int null_fd = open("/dev/null", O_RDONLY);
+        if (null_fd != -1) {
+            dup2(null_fd, 0);
+            close(null_fd);
+        }
+        dup2(pipe_fds[1], 1);
+        dup2(pipe_fds[1], 2);
+        RedirectionInfo no_redir = {0};
+        run_child(argv, &no_redir);
+    } else {
+        close(pipe_fds[1]);
+        job->pid = pid;
+        job->fd = pipe_fds[0];
+    }
+    for (int i = 0; argv[i] != NULL; i++) {
+        free(argv[i]);
+    }
+    free(argv);
+}
+
+// Stops the jobs still running after an error: their pipes are closed, then
+// each is killed and reaped.
+void parallel_abort(ParallelJob* jobs, int count) {
+    for (int i = 0; i < count; i++) {
+        if (jobs[i].fd != -1) {
+            close(jobs[i].fd);
+            jobs[i].fd = -1;
+        }
+    }
+    for (int i = 0; i < count; i++) {
+        if (!jobs[i].done && jobs[i].pid > 0) {
+            kill(jobs[i].pid, SIGKILL);
+            while (waitpid(jobs[i].pid, NULL, 0) == -1 && errno == EINTR) {
+            }
+            jobs[i].done = 1;
+        }
+    }
+}
+
+// Drains whatever is readable on a job's pipe; reaps the job on EOF.
+void parallel_read_job(ParallelJob* job) {
+    if (job->capacity - job->length < PARALLEL_READ_CHUNK) {
+        size_t new_capacity = job->capacity + (job->capacity > PARALLEL_READ_CHUNK ? job->capacity : PARALLEL_READ_CHUNK);
+        char* new_output = (char*)realloc(job->output, new_capacity);
+        if (new_output == NULL) {
+            perror("realloc failed");
+            exit(EXIT_FAILURE);
+        }
+        job->output = new_output;
+        job->capacity = new_capacity;
+    }
+    ssize_t n = read(job->fd, job->output + job->length, job->capacity - job->length);
+    if (n > 0) {
+        job->length += n;
+        return;
+    }
+    if (n == -1 && errno == EINTR) {
+        return;
+    }
+    close(job->fd);
+    job->fd = -1;
+    int status;
+    while (waitpid(job->pid, &status, 0) == -1) {
+        if (errno != EINTR) {
+            perror("waitpid failed");
+            status = 1 << 8;
+            break;
+        }
+    }
+    job->status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+    job->done = 1;
+}
+
+// parallel [-j N] cmd [args with {}] ::: item...
+// parallel [-j N] cmd [args with {}] :::: file
+// parallel [-j N] cmd [args with {}]          (items read from stdin)
+// Keeps at most N jobs in flight, prints each job's output as one block in
+// input order, and returns the number of failed jobs (capped at 101).
+int builtin_parallel(char** argv, int argc) {
+    long max_jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    int arg = 1;
+    const char* jobs_text = NULL;
+    if (arg + 1 < argc && strcmp(argv[arg], "-j") == 0) {
+        jobs_text = argv[arg + 1];
+        arg += 2;
+    } else if (arg < argc && strncmp(argv[arg], "-j", 2) == 0 && argv[arg][2] != '\0') {
+        jobs_text = argv[arg] + 2;
+        arg++;
+    }
+    if (jobs_text != NULL) {
+        char* end;
+        errno = 0;
+        max_jobs = strtol(jobs_text, &end, 10);
+        if (*jobs_text == '\0' || *end != '\0' || errno != 0 || max_jobs < 1) {
+            fprintf(stderr, "parallel: -j takes a positive number of jobs, not '%s'\n", jobs_text);
+            return 1;
+        }
+    }
+    if (max_jobs < 1) {
+        max_jobs = 1;
+    } else if (max_jobs > PARALLEL_MAX_JOBS) {
+        max_jobs = PARALLEL_MAX_JOBS;
+    }
+
+    int cmd_start = arg;
+    int separator = cmd_start;
+    while (separator < argc && strcmp(argv[separator], ":::") != 0 && strcmp(argv[separator], "::::") != 0) {
+        separator++;
+    }
+    int tmpl_argc = separator - cmd_start;
+    if (tmpl_argc == 0) {
+        fprintf(stderr, "parallel: usage: parallel [-j N] command [args] [::: items | :::: file]\n");
+        return 1;
+    }
+
+    char** items = NULL;
+    int num_items = 0;
+    int max_items = 0;
+    int read_failed = 0;
+    if (separator == argc) {
+        read_failed = parallel_read_items(NULL, &items, &num_items, &max_items);
+    } else if (strcmp(argv[separator], ":::") == 0) {
+        items = (char**)malloc(sizeof(char*) * (argc - separator));
+        if (items == NULL) {
+            perror("malloc failed");
+            exit(EXIT_FAILURE);
+        }
+        for (int i = separator + 1; i < argc; i++) {
+            items[num_items] = strdup(argv[i]);
+            if (items[num_items] == NULL) {
+                perror("strdup failed");
+                exit(EXIT_FAILURE);
+            }
+            num_items++;
+        }
+    } else {
+        for (int i = separator + 1; i < argc && !read_failed; i++) {
+            read_failed = parallel_read_items(argv[i], &items, &num_items, &max_items);
+        }
+    }
+
+    // No more jobs than items can ever be in flight
+    if (max_jobs > num_items && num_items > 0) {
+        max_jobs = num_items;
+    }
+    ParallelJob* jobs = (ParallelJob*)calloc(num_items > 0 ? num_items : 1, sizeof(ParallelJob));
+    struct pollfd* fds = (struct pollfd*)malloc(sizeof(struct pollfd) * max_jobs);
+    int* fd_jobs = (int*)malloc(sizeof(int) * max_jobs);
+    if (jobs == NULL || fds == NULL || fd_jobs == NULL) {
+        perror("malloc failed");
+        exit(EXIT_FAILURE);
+    }
+
+    struct timespec start_time, end_time;
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+
+    int next_start = 0;
+    int next_print = 0;
+    int running = 0;
+    int failed = 0;
+    while (next_print < num_items) {
+        while (running < max_jobs && next_start < num_items) {
+            parallel_start_job(&jobs[next_start], argv + cmd_start, tmpl_argc, items[next_start]);
+            if (!jobs[next_start].done) {
+                running++;
+            }
+            next_start++;
+        }
+
+        int nfds = 0;
+        for (int i = next_print; i < next_start; i++) {
+            if (jobs[i].fd != -1) {
+                fds[nfds].fd = jobs[i].fd;
+                fds[nfds].events = POLLIN;
+                fd_jobs[nfds] = i;
+                nfds++;
+            }
+        }
+        if (nfds > 0) {
+            if (poll(fds, nfds, -1) == -1) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                perror("parallel: poll failed");
+                parallel_abort(jobs + next_print, next_start - next_print);
+                failed += num_items - next_print;
+                break;
+            }
+            for (int i = 0; i < nfds; i++) {
+                if (fds[i].revents != 0) {
+                    parallel_read_job(&jobs[fd_jobs[i]]);
+                    if (jobs[fd_jobs[i]].done) {
+                        running--;
+                    }
+                }
+            }
+        }
+
+        while (next_print < next_start && jobs[next_print].done) {
+            ParallelJob* job = &jobs[next_print];
+            fwrite(job->output, 1, job->length, stdout);
+            fflush(stdout);
+            if (job->status != 0) {
+                failed++;
+            }
+            free(job->output);
+            job->output = NULL;
+            next_print++;
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end_time);
+    double elapsed = (end_time.tv_sec - start_time.tv_sec) + (end_time.tv_nsec - start_time.tv_nsec) / 1e9;
+    fprintf(stderr, "parallel: %d jobs, %d failed, %.3f s, %.1f jobs/sec\n",
+            num_items, failed, elapsed, elapsed > 0 ? num_items / elapsed : 0.0);
+
+    for (int i = 0; i < num_items; i++) {
+        free(jobs[i].output);
+        free(items[i]);
+    }
+    free(items);
+    free(jobs);
+    free(fds);
+    free(fd_jobs);
+
+    if (read_failed) {
+        return 1;
+    }
+    return failed > PARALLEL_MAX_FAILED ? PARALLEL_MAX_FAILED : failed;
+}
+
+// Adds the identity of the file at path, if it exists, to the cache key
+void cache_key_file(StringBuffer* key, const char* path) {
+    struct stat st;
+    if (stat(path, &st) == 0) {
+        char text[160];
+        int len = snprintf(text, sizeof(text), "%s:%lu:%lu:%lld:%ld.%09ld", path, (unsigned long)st.st_dev,
+                           (unsigned long)st.st_ino, (long long)st.st_size, (long)st.st_mtim.tv_sec,
+                           st.st_mtim.tv_nsec);
+        buffer_append(key, text, (size_t)len < sizeof(text) ? (size_t)len : sizeof(text) - 1);
+        buffer_append(key, "", 1);
+    }
+}
+
+// Adds what the command will read on stdin to the cache key: the text of a
+// here-document, or the identity and offset of the file or /dev/null it was
+// redirected from. Without a redirection stdin is the shell's own input, the
+// terminal or a script, which is not passed on (CACHE_INPUT_NONE): the command
+// gets /dev/null. A redirection from a pipe, FIFO, socket or terminal cannot
+// be identified; returns CACHE_INPUT_UNKNOWN.
+int cache_key_input(StringBuffer* key, const RedirectionInfo* redir_info) {
+    struct stat st, null_st;
+    if (!stdin_redirected) {
+        buffer_append(key, "<none", 6);
+        return CACHE_INPUT_NONE;
+    }
+    if (redir_info != NULL && redir_info->here_body != NULL) {
+        buffer_append(key, "<<", 2);
+        buffer_append(key, redir_info->here_body, redir_info->here_length);
+        buffer_append(key, "", 1);
+        return CACHE_INPUT_KNOWN;
+    }
+    if (fstat(0, &st) == -1) {
+        return CACHE_INPUT_UNKNOWN;
+    }
+    if (S_ISREG(st.st_mode)) {
+        char text[4400];
+        int len = snprintf(text, sizeof(text), "<%s:%lu:%lu:%lld:%ld.%09ld@%lld",
+                           (redir_info != NULL && redir_info->input_file != NULL) ? redir_info->input_file : "",
+                           (unsigned long)st.st_dev, (unsigned long)st.st_ino, (long long)st.st_size,
+                           (long)st.st_mtim.tv_sec, st.st_mtim.tv_nsec, (long long)lseek(0, 0, SEEK_CUR));
+        buffer_append(key, text, (size_t)len < sizeof(text) ? (size_t)len : sizeof(text) - 1);
+        buffer_append(key, "", 1);
+        return CACHE_INPUT_KNOWN;
+    }
+    if (S_ISCHR(st.st_mode) && stat("/dev/null", &null_st) == 0 && st.st_rdev == null_st.st_rdev) {
+        buffer_append(key, "<null", 6);
+        return CACHE_INPUT_KNOWN;
+    }
+    return CACHE_INPUT_UNKNOWN;
+}
+
+// Everything a deterministic command's result depends on: cwd, argv, the env
+// vars named by MICRO_SHELL_CACHE_ENV (PATH by default), the inode, size and
+// mtime of the executable and of every argument naming an existing file, and
+// its input (see cache_key_input, whose result is returned).
+int cache_build_key(StringBuffer* key, char** argv, int argc, const RedirectionInfo* redir_info) {
+    char cwd[4096];
+    if (getcwd(cwd, sizeof(cwd)) != NULL) {
+        buffer_append(key, cwd, strlen(cwd) + 1);
+    }
+    for (int i = 0; i < argc; i++) {
+        buffer_append(key, argv[i], strlen(argv[i]) + 1);
+    }
+
+    char* names = getenv("MICRO_SHELL_CACHE_ENV");
+    char* names_copy = strdup(names != NULL ? names : CACHE_DEFAULT_ENV);
+    if (names_copy == NULL) {
+        perror("strdup failed");
+        exit(EXIT_FAILURE);
+    }
+    char* save = NULL;
+    for (char* name = strtok_r(names_copy, ": ", &save); name != NULL; name = strtok_r(NULL, ": ", &save)) {
+        char* value = getenv(name);
+        buffer_append(key, name, strlen(name));
+        buffer_append(key, "=", 1);
+        if (value != NULL) {
+            buffer_append(key, value, strlen(value));
+        }
+        buffer_append(key, "", 1);
+    }
+    free(names_copy);
+
+    if (strchr(argv[0], '/') != NULL) {
+        cache_key_file(key, argv[0]);
+    } else if (find_builtin(argv[0]) == NULL) {
+        // The executable execvp would pick
+        char* path = getenv("PATH");
+        char* path_copy = strdup(path != NULL ? path : "/bin:/usr/bin");
+        if (path_copy == NULL) {
+            perror("strdup failed");
+            exit(EXIT_FAILURE);
+        }
+        for (char* dir = strtok_r(path_copy, ":", &save); dir != NULL; dir = strtok_r(NULL, ":", &save)) {
+            char candidate[4096];
+            snprintf(candidate, sizeof(candidate), "%s/%s", dir, argv[0]);
+            if (access(candidate, X_OK) == 0) {
+                cache_key_file(key, candidate);
+                break;
+            }
+        }
+        free(path_copy);
+    }
+    for (int i = 1; i < argc; i++) {
+        cache_key_file(key, argv[i]);
+    }
+    return cache_key_input(key, redir_info);
+}
+
+// Store directory: MICRO_SHELL_CACHE_DIR, or ~/.micro_shell_cache
+int cache_dir(char* dir, size_t size) {
+    char* configured = getenv("MICRO_SHELL_CACHE_DIR");
+    char* home = getenv("HOME");
+    if (configured != NULL && *configured != '\0') {
+        snprintf(dir, size, "%s", configured);
+    } else if (home != NULL) {
+        snprintf(dir, size, "%s/%s", home, CACHE_DIR_NAME);
+    } else {
+        return -1;
+    }
+    if (mkdir(dir, 0700) == -1 && errno != EEXIST) {
+        perror("cache: mkdir failed");
+        return -1;
+    }
+    return 0;
+}
+
+// Replays a stored result if the entry exists and was stored under exactly
+// this key. Returns the command's exit status, or -1 on a miss.
+int cache_replay(const char* path, StringBuffer* key) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(CacheHeader)) {
+        close(fd);
+        return -1;
+    }
+    char* entry = (char*)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (entry == MAP_FAILED) {
+        close(fd);
+        return -1;
+    }
+    CacheHeader header;
+    memcpy(&header, entry, sizeof(header));
+    int status = -1;
+    if (header.magic == CACHE_MAGIC && header.key_length == key->length &&
+        sizeof(header) + header.key_length + header.out_length + header.err_length == (uint64_t)st.st_size &&
+        memcmp(entry + sizeof(header), key->data, key->length) == 0) {
+        char* out = entry + sizeof(header) + header.key_length;
+        fflush(stdout);
+        write_full(1, out, header.out_length);
+        write_full(2, out + header.out_length, header.err_length);
+        status = header.status;
+        // Mark the entry as recently used for eviction
+        futimens(fd, NULL);
+    }
+    munmap(entry, st.st_size);
+    close(fd);
+    return status;
+}
+
+int compare_cache_entries(const void* a, const void* b) {
+    const CacheEntry* x = (const CacheEntry*)a;
+    const CacheEntry* y = (const CacheEntry*)b;
+    if (x->used.tv_sec != y->used.tv_sec) {
+        return (x->used.tv_sec > y->used.tv_sec) - (x->used.tv_sec < y->used.tv_sec);
+    }
+    return (x->used.tv_nsec > y->used.tv_nsec) - (x->used.tv_nsec < y->used.tv_nsec);
+}
+
+// Deletes the least recently used entries until the store fits in max_bytes.
+// Returns the size of the store afterwards, -1 when it could not be read.
+long cache_evict(const char* dir, long max_bytes) {
+    DIR* d = opendir(dir);
+    if (d == NULL) {
+        return -1;
+    }
+    CacheEntry* entries = NULL;
+    int count = 0;
+    int capacity = 0;
+    long total = 0;
+    struct dirent* ent;
+    while ((ent = readdir(d)) != NULL) {
+        struct stat st;
+        if (ent->d_name[0] == '.' || fstatat(dirfd(d), ent->d_name, &st, 0) == -1 || !S_ISREG(st.st_mode)) {
+            continue;
+        }
+        if (count == capacity) {
+            capacity = (capacity == 0) ? 64 : capacity * 2;
+            CacheEntry* new_entries = (CacheEntry*)realloc(entries, sizeof(CacheEntry) * capacity);
+            if (new_entries == NULL) {
+                perror("realloc failed");
+                exit(EXIT_FAILURE);
+            }
+            entries = new_entries;
+        }
+        entries[count].name = strdup(ent->d_name);
+        if (entries[count].name == NULL) {
+            perror("strdup failed");
+            exit(EXIT_FAILURE);
+        }
+        entries[count].used = st.st_mtim;
+        entries[count].size = st.st_size;
+        total += st.st_size;
+        count++;
+    }
+    if (total > max_bytes) {
+        qsort(entries, count, sizeof(CacheEntry), compare_cache_entries);
+        for (int i = 0; i < count && total > max_bytes; i++) {
+            if (unlinkat(dirfd(d), entries[i].name, 0) == 0) {
+                total -= entries[i].size;
+            }
+        }
+    }
+    for (int i = 0; i < count; i++) {
+        free(entries[i].name);
+    }
+    free(entries);
+    closedir(d);
+    return total;
+}
+
+// Writes a new entry under a temporary name and renames it into place, so a
+// concurrent reader never sees a partial entry. Returns the entry's size, or
+// -1 when it was not stored.
+long cache_store(const char* dir, const char* path, StringBuffer* key, int status, const char* out,
+                 size_t out_length, const char* err, size_t err_length) {
+    char tmp_path[4200];
+    snprintf(tmp_path, sizeof(tmp_path), "%s/.tmp.%d", dir, (int)getpid());
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd == -1) {
+        perror("cache: open failed");
+        return -1;
+    }
+    CacheHeader header = {CACHE_MAGIC, status, key->length, out_length, err_length};
+    if (write_full(fd, &header, sizeof(header)) == -1 || write_full(fd, key->data, key->length) == -1 ||
+        write_full(fd, out, out_length) == -1 || write_full(fd, err, err_length) == -1) {
+        perror("cache: write failed");
+        close(fd);
+        unlink(tmp_path);
+        return -1;
+    }
+    close(fd);
+    if (rename(tmp_path, path) == -1) {
+        perror("cache: rename failed");
+        unlink(tmp_path);
+        return -1;
+    }
+    return sizeof(header) + key->length + out_length + err_length;
+}
+
+// Maps the whole of a memfd the command wrote to; NULL when it is empty
+char* cache_map_output(int fd, size_t* length) {
+    struct stat st;
+    *length = 0;
+    if (fstat(fd, &st) == -1 || st.st_size == 0) {
+        return NULL;
+    }
+    char* data = (char*)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        return NULL;
+    }
+    *length = st.st_size;
+    return data;
+}
+
+// cache cmd [args...]
+// Runs a deterministic command once and replays its stdout, stderr and exit
+// status from an on-disk store afterwards, without spawning anything, for as
+// long as its key (see cache_build_key) is unchanged. A command with stdin
+// redirected from a pipe, FIFO or terminal always runs, and one without a
+// redirection reads /dev/null. The store is capped at MICRO_SHELL_CACHE_MAX
+// bytes (64MB by default), evicting least recently used entries.
+int builtin_cache(char** argv, int argc) {
+    if (argc < 2) {
+        fprintf(stderr, "cache: usage: cache command [args]\n");
+        return 1;
+    }
+    char dir[4096];
+    if (cache_dir(dir, sizeof(dir)) == -1) {
+        return 1;
+    }
+    StringBuffer key = {NULL, 0, 0};
+    int input = cache_build_key(&key, argv + 1, argc - 1, builtin_redirections);
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < key.length; i++) {
+        hash = (hash ^ (unsigned char)key.data[i]) * 1099511628211ull;
+    }
+    char path[4200];
+    snprintf(path, sizeof(path), "%s/%016llx", dir, (unsigned long long)hash);
+
+    // Input that cannot be identified is neither replayed nor stored
+    int status = (input != CACHE_INPUT_UNKNOWN) ? cache_replay(path, &key) : -1;
+    if (status != -1) {
+        free(key.data);
+        return status;
+    }
+
+    // Miss: run it with stdout and stderr in memory files
+    int out_fd = memfd_create("cache-stdout", MFD_CLOEXEC);
+    int err_fd = memfd_create("cache-stderr", MFD_CLOEXEC);
+    if (out_fd == -1 || err_fd == -1) {
+        perror("cache: memfd_create failed");
+        free(key.data);
+        return 1;
+    }
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork failed");
+        close(out_fd);
+        close(err_fd);
+        free(key.data);
+        return 1;
+    } else if (pid == 0) {
+        RedirectionInfo no_redir = {0};
+        if (dup2(out_fd, 1) == -1 || dup2(err_fd, 2) == -1) {
+            _exit(EXIT_FAILURE);
+        }
+        if (input == CACHE_INPUT_NONE) {
+            int null_fd = open("/dev/null", O_RDONLY);
+            if (null_fd == -1 || dup2(null_fd, 0) == -1) {
+                _exit(EXIT_FAILURE);
+            }
+            close(null_fd);
+        }
+        if (execute_builtin(argv + 1, argc - 1, &no_redir) == 0 && execute_utility(argv + 1, argc - 1, &no_redir) == 0) {
+            run_child(argv + 1, &no_redir);
+        }
+        fflush(stdout);
+        _exit(last_exit_status);
+    }
+    int wait_status = 0;
+    pid_t waited;
+    while ((waited = waitpid(pid, &wait_status, 0)) == -1 && errno == EINTR) {
+    }
+    if (waited == -1) {
+        perror("cache: waitpid failed");
+        status = 1;
+    } else if (WIFEXITED(wait_status)) {
+        status = WEXITSTATUS(wait_status);
+    } else {
+        status = 128 + WTERMSIG(wait_status);
+    }
+
+    size_t out_length, err_length;
+    char* out = cache_map_output(out_fd, &out_length);
+    char* err = cache_map_output(err_fd, &err_length);
+    write_full(1, out, out_length);
+    write_full(2, err, err_length);
+    // A command killed by a signal did not produce its real result, and one
+    // whose status was lost has no known result to replay
+    if (waited != -1 && WIFEXITED(wait_status) && input != CACHE_INPUT_UNKNOWN) {
+        long stored = cache_store(dir, path, &key, status, out, out_length, err, err_length);
+        char* max = getenv("MICRO_SHELL_CACHE_MAX");
+        long max_bytes = (max != NULL && atol(max) > 0) ? atol(max) : CACHE_DEFAULT_MAX_BYTES;
+        if (stored > 0 && cache_store_bytes != -1) {
+            cache_store_bytes += stored;
+        }
+        // Other shells share the store, so the running size is an estimate;
+        // the scan that evicts puts it right
+        if (cache_store_bytes == -1 || cache_store_bytes > max_bytes) {
+            cache_store_bytes = cache_evict(dir, max_bytes);
+        }
+    }
+    if (out != NULL) {
+        munmap(out, out_length);
+    }
+    if (err != NULL) {
+        munmap(err, err_length);
+    }
+    close(out_fd);
+    close(err_fd);
+    free(key.data);
+    return status;
+}
+
+int trie_new_node(CommandTrie* trie, char c) {
+    if (trie->num_nodes == trie->max_nodes) {
+        trie->max_nodes = (trie->max_nodes == 0) ? 4096 : trie->max_nodes * 2;
+        TrieNode* new_nodes = (TrieNode*)realloc(trie->nodes, sizeof(TrieNode) * trie->max_nodes);
+        if (new_nodes == NULL) {
+            perror("realloc failed");
+            exit(EXIT_FAILURE);
+        }
+        trie->nodes = new_nodes;
+    }
+    TrieNode* node = &trie->nodes[trie->num_nodes];
+    node->child = 0;
+    node->sibling = 0;
+    node->dirs = 0;
+    node->c = c;
+    return trie->num_nodes++;
+}
+
+// Returns the node spelling name, creating it when create is set; 0 if absent.
+int trie_lookup(CommandTrie* trie, const char* name, int create) {
+    int node = 0;
+    for (const char* p = name; *p != '\0'; p++) {
+        int* link = &trie->nodes[node].child;
+        while (*link != 0 && trie->nodes[*link].c < *p) {
+            link = &trie->nodes[*link].sibling;
+        }
+        if (*link == 0 || trie->nodes[*link].c != *p) {
+            if (!create) {
+                return 0;
+            }
+            int link_offset = (int)((char*)link - (char*)trie->nodes);
+            int new_node = trie_new_node(trie, *p);
+            // trie_new_node may have moved the array
+            link = (int*)((char*)trie->nodes + link_offset);
+            trie->nodes[new_node].sibling = *link;
+            *link = new_node;
+        }
+        node = *link;
+    }
+    return node;
+}
+
+// True when a PATH directory from TRIE_SHARED_DIR on, other than dir, still
+// holds name: their shared bit may only be cleared when none does.
+int trie_in_shared_dirs(CommandTrie* trie, const char* name, int dir) {
+    char path[PATH_MAX];
+    for (int i = TRIE_SHARED_DIR; i < trie->num_dirs; i++) {
+        if (i != dir && snprintf(path, sizeof(path), "%s/%s", trie->dirs[i], name) < (int)sizeof(path) &&
+            access(path, F_OK) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void trie_update(CommandTrie* trie, const char* name, int dir, int present) {
+    int shared = (dir >= TRIE_SHARED_DIR);
+    uint64_t bit = (uint64_t)1 << (shared ? TRIE_SHARED_DIR : dir);
+    int node = trie_lookup(trie, name, present);
+    if (node == 0) {
+        return;
+    }
+    if (present) {
+        trie->nodes[node].dirs |= bit;
+    } else if (!shared || !trie_in_shared_dirs(trie, name, dir)) {
+        trie->nodes[node].dirs &= ~bit;
+    }
+}
+
+void trie_free(CommandTrie* trie) {
+    if (trie->inotify_fd != -1) {
+        close(trie->inotify_fd);
+    }
+    free(trie->nodes);
+    free(trie->path);
+    free(trie->dir_list);
+    free(trie->dirs);
+    free(trie->watches);
+    trie->dir_list = NULL;
+    trie->dirs = NULL;
+    trie->watches = NULL;
+    trie->max_dirs = 0;
+    trie->nodes = NULL;
+    trie->num_nodes = trie->max_nodes = 0;
+    trie->path = NULL;
+    trie->inotify_fd = -1;
+    trie->num_dirs = 0;
+}
+
+// Reads every PATH directory once and starts watching it. Directory entries
+// are taken from d_type, without a stat per name.
+void trie_build(CommandTrie* trie, const char* path) {
+    trie_free(trie);
+    trie->path = strdup(path);
+    trie_new_node(trie, '\0');
+    trie->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+    trie->dir_list = strdup(path);
+    if (trie->path == NULL || trie->dir_list == NULL) {
+        perror("strdup failed");
+        exit(EXIT_FAILURE);
+    }
+    char* save = NULL;
+    for (char* dir = strtok_r(trie->dir_list, ":", &save); dir != NULL; dir = strtok_r(NULL, ":", &save)) {
+        if (trie->num_dirs == trie->max_dirs) {
+            trie->max_dirs = (trie->max_dirs == 0) ? 16 : trie->max_dirs * 2;
+            char** new_dirs = (char**)realloc(trie->dirs, sizeof(char*) * trie->max_dirs);
+            int* new_watches = (int*)realloc(trie->watches, sizeof(int) * trie->max_dirs);
+            if (new_dirs == NULL || new_watches == NULL) {
+                perror("realloc failed");
+                exit(EXIT_FAILURE);
+            }
+            trie->dirs = new_dirs;
+            trie->watches = new_watches;
+        }
+        int index = trie->num_dirs++;
+        trie->dirs[index] = dir;
+        trie->watches[index] = -1;
+        if (trie->inotify_fd != -1) {
+            trie->watches[index] = inotify_add_watch(trie->inotify_fd, dir,
+                                                     IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR);
+        }
+        DIR* d = opendir(dir);
+        if (d == NULL) {
+            continue;
+        }
+        struct dirent* entry;
+        while ((entry = readdir(d)) != NULL) {
+            if (entry->d_type != DT_DIR && entry->d_name[0] != '.') {
+                trie_update(trie, entry->d_name, index, 1);
+            }
+        }
+        closedir(d);
+    }
+}
+
+// Brings the trie up to date: rebuilt when PATH changed or events were lost,
+// otherwise patched from the pending inotify events.
+void trie_sync(CommandTrie* trie) {
+    const char* path = getenv("PATH");
+    if (path == NULL) {
+        path = "";
+    }
+    if (trie->nodes == NULL || strcmp(trie->path, path) != 0) {
+        trie_build(trie, path);
+        return;
+    }
+    if (trie->inotify_fd == -1) {
+        return;
+    }
+    char buffer[INOTIFY_BUFFER_SIZE] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t n;
+    while ((n = read(trie->inotify_fd, buffer, sizeof(buffer))) > 0) {
+        for (char* p = buffer; p < buffer + n;) {
+            struct inotify_event* event = (struct inotify_event*)p;
+            p += sizeof(struct inotify_event) + event->len;
+            if (event->mask & IN_Q_OVERFLOW) {
+                trie_build(trie, path);
+                return;
+            }
+            if (event->len == 0 || (event->mask & IN_ISDIR) || event->name[0] == '.') {
+                continue;
+            }
+            for (int i = 0; i < trie->num_dirs; i++) {
+                if (trie->watches[i] == event->wd) {
+                    trie_update(trie, event->name, i, (event->mask & (IN_CREATE | IN_MOVED_TO)) != 0);
+                }
+            }
+        }
+    }
+}
+
+void completion_add(CompletionList* list, const char* text, size_t len) {
+    if (list->count == list->capacity) {
+        list->capacity = (list->capacity == 0) ? 64 : list->capacity * 2;
+        char** new_items = (char**)realloc(list->items, sizeof(char*) * list->capacity);
+        if (new_items == NULL) {
+            perror("realloc failed");
+            exit(EXIT_FAILURE);
+        }
+        list->items = new_items;
+    }
+    list->items[list->count] = strndup(text, len);
+    if (list->items[list->count] == NULL) {
+        perror("strndup failed");
+        exit(EXIT_FAILURE);
+    }
+    list->count++;
+}
+
+// Adds every name below node, which spells the first depth chars of name.
+void trie_collect(CommandTrie* trie, int node, char* name, int depth, int max_depth, CompletionList* list) {
+    if (trie->nodes[node].dirs != 0) {
+        completion_add(list, name, depth);
+    }
+    if (depth >= max_depth) {
+        return;
+    }
+    for (int child = trie->nodes[node].child; child != 0; child = trie->nodes[child].sibling) {
+        name[depth] = trie->nodes[child].c;
+        trie_collect(trie, child, name, depth + 1, max_depth, list);
+    }
+}
+
+void complete_commands(const char* prefix, CompletionList* list) {
+    int slot = 0;
+    for (const char* name = next_builtin_name(&slot); name != NULL; name = next_builtin_name(&slot)) {
+        if (strncmp(name, prefix, strlen(prefix)) == 0) {
+            completion_add(list, name, strlen(name));
+        }
+    }
+    trie_sync(&command_trie);
+    int node = trie_lookup(&command_trie, prefix, 0);
+    if (node == 0 && *prefix != '\0') {
+        return;
+    }
+    char name[MAX_INPUT];
+    size_t prefix_len = strlen(prefix);
+    memcpy(name, prefix, prefix_len);
+    trie_collect(&command_trie, node, name, prefix_len, MAX_INPUT - 1, list);
+}
+
+void complete_variables(const char* prefix, CompletionList* list) {
+    size_t prefix_len = strlen(prefix);
+    char name[MAX_INPUT];
+    for (int i = 0; i < numShellVars; i++) {
+        snprintf(name, sizeof(name), "$%s", shellVars[i].name);
+        if (strncmp(name, prefix, prefix_len) == 0) {
+            completion_add(list, name, strlen(name));
+        }
+    }
+}
+
+void complete_files(const char* prefix, CompletionList* list) {
+    const char* slash = strrchr(prefix, '/');
+    const char* base = (slash != NULL) ? slash + 1 : prefix;
+    size_t dir_len = base - prefix;
+    size_t base_len = strlen(base);
+    char dir[MAX_INPUT];
+    if (dir_len > 0) {
+        snprintf(dir, sizeof(dir), "%.*s", (int)dir_len, prefix);
+    } else {
+        strcpy(dir, ".");
+    }
+    DIR* d = opendir(dir);
+    if (d == NULL) {
+        return;
+    }
+    struct dirent* entry;
+    char candidate[MAX_INPUT];
+    while ((entry = readdir(d)) != NULL) {
+        if (strncmp(entry->d_name, base, base_len) != 0 || strcmp(entry->d_name, ".") == 0 ||
+            strcmp(entry->d_name, "..") == 0 || (entry->d_name[0] == '.' && base[0] != '.')) {
+            continue;
+        }
+        int is_dir = (entry->d_type == DT_DIR);
+        if (entry->d_type == DT_UNKNOWN || entry->d_type == DT_LNK) {
+            struct stat st;
+            is_dir = (fstatat(dirfd(d), entry->d_name, &st, 0) == 0 && S_ISDIR(st.st_mode));
+        }
+        int len = snprintf(candidate, sizeof(candidate), "%.*s%s%s", (int)dir_len, prefix, entry->d_name,
+                           is_dir ? "/" : "");
+        if (len < (int)sizeof(candidate)) {
+            completion_add(list, candidate, len);
+        }
+    }
+    closedir(d);
+}
+
+int compare_strings(const void* a, const void* b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+void redraw_line(const char* prompt, const char* buf, int len, int pos) {
+    printf("\r%s%s\x1b[K", prompt, buf);
+    if (pos < len) {
+        printf("\x1b[%dD", len - pos);
+    }
+    fflush(stdout);
+}
+
+// Completes the word that ends at the cursor: variables after '$', commands in
+// the first word, file paths elsewhere. A single match is inserted; several
+// matches extend the word to their common prefix, or are listed.
+void complete_word(const char* prompt, char* buf, int size, int* len, int* pos) {
+    int start = *pos;
+    while (start > 0 && buf[start - 1] != ' ') {
+        start--;
+    }
+    int first_word = 1;
+    for (int i = 0; i < start; i++) {
+        if (buf[i] != ' ') {
+            first_word = 0;
+        }
+    }
+    char prefix[MAX_INPUT];
+    snprintf(prefix, sizeof(prefix), "%.*s", *pos - start, buf + start);
+
+    CompletionList list = {NULL, 0, 0};
+    if (prefix[0] == '$') {
+        complete_variables(prefix, &list);
+    } else if (first_word && strchr(prefix, '/') == NULL) {
+        complete_commands(prefix, &list);
+    } else {
+        complete_files(prefix, &list);
+    }
+    if (list.count == 0) {
+        printf("\a");
+        fflush(stdout);
+        return;
+    }
+    qsort(list.items, list.count, sizeof(char*), compare_strings);
+    int unique = 1;
+    for (int i = 1; i < list.count; i++) {
+        if (strcmp(list.items[i], list.items[unique - 1]) != 0) {
+            list.items[unique++] = list.items[i];
+        } else {
+            free(list.items[i]);
+        }
+    }
+    list.count = unique;
+
+    size_t common = strlen(list.items[0]);
+    for (int i = 1; i < list.count; i++) {
+        size_t j = 0;
+        while (j < common && list.items[i][j] == list.items[0][j]) {
+            j++;
+        }
+        common = j;
+    }
+    char insert[MAX_INPUT];
+    size_t prefix_len = strlen(prefix);
+    int insert_len = snprintf(insert, sizeof(insert), "%.*s", (int)(common - prefix_len), list.items[0] + prefix_len);
+    if (list.count == 1 && list.items[0][common - 1] != '/') {
+        insert[insert_len++] = ' ';
+        insert[insert_len] = '\0';
+    }
+    if (insert_len > 0 && *len + insert_len < size) {
+        memmove(buf + *pos + insert_len, buf + *pos, *len - *pos + 1);
+        memcpy(buf + *pos, insert, insert_len);
+        *len += insert_len;
+        *pos += insert_len;
+    } else if (list.count > 1) {
+        printf("\n");
+        for (int i = 0; i < list.count && i < COMPLETION_MAX_SHOW; i++) {
+            printf("%s  ", list.items[i]);
+        }
+        if (list.count > COMPLETION_MAX_SHOW) {
+            printf("... (%d more)", list.count - COMPLETION_MAX_SHOW);
+        }
+        printf("\n");
+    }
+    redraw_line(prompt, buf, *len, *pos);
+    for (int i = 0; i < list.count; i++) {
+        free(list.items[i]);
+    }
+    free(list.items);
+}
+
+// Opens $MICRO_SHELL_HISTFILE (default ~/.micro_shell_history) and maps it.
+void history_open() {
+    char path[4096];
+    const char* file = getenv("MICRO_SHELL_HISTFILE");
+    if (file != NULL && *file == '\0') {
+        return; // set but empty: no history
+    }
+    if (file == NULL) {
+        const char* home = getenv("HOME");
+        if (home == NULL) {
+            return;
+        }
+        snprintf(path, sizeof(path), "%s/%s", home, HISTORY_FILE_NAME);
+        file = path;
+    }
+    history.fd = open(file, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    if (history.fd == -1) {
+        return;
+    }
+    struct stat st;
+    if (fstat(history.fd, &st) == 0 && st.st_size > 0) {
+        void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, history.fd, 0);
+        if (map != MAP_FAILED) {
+            history.map = (char*)map;
+            history.map_size = st.st_size;
+        }
+    }
+}
+
+void history_index_add(const char* text, size_t length) {
+    if (history.num_lines == history.max_lines) {
+        history.max_lines = (history.max_lines == 0) ? 1024 : history.max_lines * 2;
+        HistoryLine* new_lines = (HistoryLine*)realloc(history.lines, sizeof(HistoryLine) * history.max_lines);
+        if (new_lines == NULL) {
+            perror("realloc failed");
+            exit(EXIT_FAILURE);
+        }
+        history.lines = new_lines;
+    }
+    history.lines[history.num_lines].text = text;
+    history.lines[history.num_lines].length = length;
+    history.num_lines++;
+}
+
+// Builds the index of entries on first use: one pass over the mapped file for
+// its non-empty lines, then the session entries.
+void history_index() {
+    if (history.indexed) {
+        return;
+    }
+    size_t pos = 0;
+    while (pos < history.map_size) {
+        char* newline = (char*)memchr(history.map + pos, '\n', history.map_size - pos);
+        size_t end = (newline != NULL) ? (size_t)(newline - history.map) : history.map_size;
+        if (end > pos) {
+            history_index_add(history.map + pos, end - pos);
+        }
+        pos = end + 1;
+    }
+    for (int i = 0; i < history.num_session; i++) {
+        history_index_add(history.session[i], strlen(history.session[i]));
+    }
+    history.indexed = 1;
+}
+
+// Moves to the next older entry; returns 0 when there is none.
+int history_older(HistoryCursor* cursor) {
+    if (cursor->line == -1) {
+        history_index();
+        if (history.num_lines == 0) {
+            return 0;
+        }
+        cursor->line = history.num_lines - 1;
+        return 1;
+    }
+    if (cursor->line == 0) {
+        return 0;
+    }
+    cursor->line--;
+    return 1;
+}
+
+// Moves to the next newer entry; returns 0 when back on the edited line.
+int history_newer(HistoryCursor* cursor) {
+    if (cursor->line == -1) {
+        return 0;
+    }
+    if (++cursor->line == history.num_lines) {
+        cursor->line = -1;
+        return 0;
+    }
+    return 1;
+}
+
+const char* history_entry(HistoryCursor* cursor, size_t* len) {
+    *len = history.lines[cursor->line].length;
+    return history.lines[cursor->line].text;
+}
+
+// The newest entry, without building the index; NULL when there is none.
+const char* history_last(size_t* len) {
+    if (history.indexed) {
+        if (history.num_lines == 0) {
+            return NULL;
+        }
+        *len = history.lines[history.num_lines - 1].length;
+        return history.lines[history.num_lines - 1].text;
+    }
+    if (history.num_session > 0) {
+        *len = strlen(history.session[history.num_session - 1]);
+        return history.session[history.num_session - 1];
+    }
+    // The last non-empty line of the mapped file
+    size_t end = history.map_size;
+    while (end > 0 && history.map[end - 1] == '\n') {
+        end--;
+    }
+    if (end == 0) {
+        return NULL;
+    }
+    char* newline = (char*)memrchr(history.map, '\n', end);
+    size_t start = (newline != NULL) ? (size_t)(newline - history.map) + 1 : 0;
+    *len = end - start;
+    return history.map + start;
+}
+
+// Appends a line to the history. Each entry reaches the file in one O_APPEND
+// write, so concurrent shells never interleave inside an entry.
+void history_add(const char* line) {
+    if (history.fd == -1 || *line == '\0') {
+        return;
+    }
+    size_t len = strlen(line);
+    size_t last_len;
+    const char* last = history_last(&last_len);
+    if (last != NULL && last_len == len && memcmp(last, line, len) == 0) {
+        return;
+    }
+    if (history.num_session == history.max_session) {
+        history.max_session = (history.max_session == 0) ? 64 : history.max_session * 2;
+        char** new_session = (char**)realloc(history.session, sizeof(char*) * history.max_session);
+        if (new_session == NULL) {
+            perror("realloc failed");
+            exit(EXIT_FAILURE);
+        }
+        history.session = new_session;
+    }
+    char* entry = (char*)malloc(len + 2);
+    if (entry == NULL) {
+        perror("malloc failed");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(entry, line, len);
+    entry[len] = '\n';
+    write_full(history.fd, entry, len + 1);
+    entry[len] = '\0';
+    history.session[history.num_session++] = entry;
+    if (history.indexed) {
+        history_index_add(entry, len);
+    }
+}
+
+// Replaces the edited line with the entry under the cursor.
+void history_load(HistoryCursor* cursor, char* buf, int size, int* len, int* pos) {
+    size_t entry_len;
+    const char* entry = history_entry(cursor, &entry_len);
+    if (entry_len > (size_t)size - 2) {
+        entry_len = size - 2;
+    }
+    memcpy(buf, entry, entry_len);
+    buf[entry_len] = '\0';
+    *len = *pos = entry_len;
+}
+
+// Moves the cursor older (or newer) to the next entry starting with prefix.
+// Returns 0, leaving the cursor unchanged, when there is none.
+int history_step(HistoryCursor* cursor, int older, const char* prefix) {
+    HistoryCursor next = *cursor;
+    size_t prefix_len = strlen(prefix);
+    while (older ? history_older(&next) : history_newer(&next)) {
+        size_t entry_len;
+        const char* entry = history_entry(&next, &entry_len);
+        if (entry_len >= prefix_len && memcmp(entry, prefix, prefix_len) == 0) {
+            *cursor = next;
+            return 1;
+        }
+    }
+    if (!older) {
+        *cursor = next; // walked past the newest entry: back to the edited line
+    }
+    return !older;
+}
+
+// Moves the cursor to the first entry, starting at the cursor itself when
+// include_current is set, that contains query.
+int history_find(HistoryCursor* cursor, const char* query, int include_current) {
+    HistoryCursor next = *cursor;
+    size_t query_len = strlen(query);
+    if (!include_current || next.line == -1) {
+        if (!history_older(&next)) {
+            return 0;
+        }
+    }
+    do {
+        size_t entry_len;
+        const char* entry = history_entry(&next, &entry_len);
+        if (memmem(entry, entry_len, query, query_len) != NULL) {
+            *cursor = next;
+            return 1;
+        }
+    } while (history_older(&next));
+    return 0;
+}
+
+// Reads the next byte of an escape sequence, if one arrives within
+// ESCAPE_TIMEOUT_MS; a key sends its whole sequence at once, so nothing
+// arriving means the Esc key was pressed on its own. Returns 1 when a byte
+// was read.
+int read_escape_byte(char* c) {
+    struct pollfd pfd = {0, POLLIN, 0};
+    int ready;
+    while ((ready = poll(&pfd, 1, ESCAPE_TIMEOUT_MS)) == -1 && errno == EINTR) {
+    }
+    return ready == 1 && read(0, c, 1) == 1;
+}
+
+// Incremental reverse search (Ctrl-R). Returns 1 when the match is accepted
+// with Enter, 0 when the search ends with another key and editing resumes.
+int history_search(const char* prompt, char* buf, int size, int* len, int* pos) {
+    char query[MAX_INPUT] = "";
+    int query_len = 0;
+    HistoryCursor cursor = {-1};
+    int found = 0;
+    while (1) {
+        size_t entry_len = 0;
+        const char* entry = found ? history_entry(&cursor, &entry_len) : "";
+        printf("\r(reverse-i-search)`%s': %.*s\x1b[K", query, (int)entry_len, entry);
+        fflush(stdout);
+
+        char c;
+        ssize_t n = read(0, &c, 1);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0 || c == 7) { // EOF or Ctrl-G: leave the line as it was
+            break;
+        }
+        if (c == 18) { // Ctrl-R: next older match
+            if (found) {
+                found = history_find(&cursor, query, 0) || found;
+            }
+        } else if (c == 127 || c == 8) {
+            if (query_len > 0) {
+                query[--query_len] = '\0';
+            }
+            cursor.line = -1;
+            found = query_len > 0 && history_find(&cursor, query, 1);
+        } else if ((unsigned char)c >= 32 && query_len < MAX_INPUT - 1) {
+            query[query_len++] = c;
+            query[query_len] = '\0';
+            found = history_find(&cursor, query, 1);
+        } else {
+            if (found) {
+                history_load(&cursor, buf, size, len, pos);
+            }
+            if (c == 27) { // Swallow the rest of an arrow key sequence
+                char seq[2];
+                if (read_escape_byte(&seq[0]) && (seq[0] == '[' || seq[0] == 'O')) {
+                    read_escape_byte(&seq[1]);
+                }
+            }
+            if (c == '\r' || c == '\n') {
+                printf("\r%s%s\x1b[K\n", prompt, buf);
+                return 1;
+            }
+            break;
+        }
+    }
+    redraw_line(prompt, buf, *len, *pos);
+    return 0;
+}
+
+// Here-document lines typed on a terminal go through the line editor too,
+// behind a "> " prompt
+ssize_t read_terminal_continuation(char** line, size_t* capacity) {
+    char buf[MAX_INPUT];
+    if (read_line("> ", buf, MAX_INPUT) == NULL) {
+        printf("\n");
+        return -1;
+    }
+    size_t length = strcspn(buf, "\n");
+    if (*capacity < length + 1) {
+        char* new_line = (char*)realloc(*line, length + 1);
+        if (new_line == NULL) {
+            perror("realloc failed");
+            exit(EXIT_FAILURE);
+        }
+        *line = new_line;
+        *capacity = length + 1;
+    }
+    memcpy(*line, buf, length);
+    (*line)[length] = '\0';
+    return length;
+}
+
+// Reads one line into buf. On a terminal the line is edited in raw mode with
+// cursor movement and tab completion; otherwise it falls back to fgets.
+// Returns NULL on end of input.
+char* read_line(const char* prompt, char* buf, int size) {
+    printf("%s", prompt);
+    fflush(stdout);
+    struct termios saved_termios;
+    if (!isatty(0) || tcgetattr(0, &saved_termios) == -1) {
+        return fgets(buf, size, stdin);
+    }
+    struct termios raw = saved_termios;
+    raw.c_lflag &= ~(ICANON | ECHO);
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+    // TCSANOW keeps typeahead, such as the rest of a pasted block
+    tcsetattr(0, TCSANOW, &raw);
+
+    int len = 0;
+    int pos = 0;
+    buf[0] = '\0';
+    char* result = buf;
+    // Up/Down walk the entries that start with what was typed before the first Up
+    HistoryCursor cursor = {-1};
+    char history_prefix[MAX_INPUT];
+    char edited_line[MAX_INPUT];
+    int pending = -1; // a byte read after Esc that was not part of a sequence
+    while (1) {
+        char c;
+        ssize_t n = 1;
+        if (pending != -1) {
+            c = (char)pending;
+            pending = -1;
+        } else {
+            n = read(0, &c, 1);
+        }
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0 || (c == 4 && len == 0)) { // EOF or Ctrl-D on an empty line
+            result = NULL;
+            break;
+        }
+        if (c == '\r' || c == '\n') {
+            printf("\n");
+            break;
+        } else if (c == '\t') {
+            complete_word(prompt, buf, size, &len, &pos);
+        } else if (c == 18) { // Ctrl-R
+            if (history_search(prompt, buf, size, &len, &pos)) {
+                break;
+            }
+        } else if ((c == 127 || c == 8) && pos > 0) { // Backspace
+            memmove(buf + pos - 1, buf + pos, len - pos + 1);
+            pos--;
+            len--;
+            redraw_line(prompt, buf, len, pos);
+        } else if (c == 1 || c == 5) { // Ctrl-A, Ctrl-E
+            pos = (c == 1) ? 0 : len;
+            redraw_line(prompt, buf, len, pos);
+        } else if (c == 21) { // Ctrl-U
+            memmove(buf, buf + pos, len - pos + 1);
+            len -= pos;
+            pos = 0;
+            redraw_line(prompt, buf, len, pos);
+        } else if (c == 11) { // Ctrl-K
+            buf[pos] = '\0';
+            len = pos;
+            redraw_line(prompt, buf, len, pos);
+        } else if (c == 27) { // Escape sequence: arrows, Home, End
+            // A bare Esc is ignored; a byte after it that starts no sequence
+            // is handled as a key of its own
+            char seq[2];
+            if (!read_escape_byte(&seq[0])) {
+                continue;
+            }
+            if (seq[0] != '[' && seq[0] != 'O') {
+                pending = (unsigned char)seq[0];
+                continue;
+            }
+            if (read_escape_byte(&seq[1])) {
+                if (seq[1] == 'A' || seq[1] == 'B') {
+                    if (cursor.line == -1) {
+                        strcpy(history_prefix, buf);
+                        strcpy(edited_line, buf);
+                    }
+                    if (history_step(&cursor, seq[1] == 'A', history_prefix)) {
+                        if (cursor.line == -1) {
+                            strcpy(buf, edited_line);
+                            len = pos = strlen(buf);
+                        } else {
+                            history_load(&cursor, buf, size, &len, &pos);
+                        }
+                    }
+                } else if (seq[1] == 'C' && pos < len) {
+                    pos++;
+                } else if (seq[1] == 'D' && pos > 0) {
+                    pos--;
+                } else if (seq[1] == 'H') {
+                    pos = 0;
+                } else if (seq[1] == 'F') {
+                    pos = len;
+                }
+                redraw_line(prompt, buf, len, pos);
+            }
+        } else if ((unsigned char)c >= 32 && c != 127 && len < size - 2) {
+            memmove(buf + pos + 1, buf + pos, len - pos + 1);
+            buf[pos++] = c;
+            len++;
+            redraw_line(prompt, buf, len, pos);
+        }
+    }
+    tcsetattr(0, TCSADRAIN, &saved_termios);
+    return result;
+}
+
+// Sends data with nfds file descriptors attached as SCM_RIGHTS.
+int send_fds(int sock, const void* data, size_t len, const int* fds, int nfds) {
+    char control[CMSG_SPACE(sizeof(int) * 3)];
+    struct iovec iov = {(void*)data, len};
+    struct msghdr msg = {0};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = CMSG_SPACE(sizeof(int) * nfds);
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * nfds);
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * nfds);
+    ssize_t n;
+    do {
+        n = sendmsg(sock, &msg, MSG_NOSIGNAL);
+    } while (n == -1 && errno == EINTR);
+    return (n == (ssize_t)len) ? 0 : -1;
+}
+
+// Receives exactly len bytes of data plus up to max_fds descriptors.
+// Returns the number of descriptors received, or -1.
+int recv_fds(int sock, void* data, size_t len, int* fds, int max_fds, int flags) {
+    char control[CMSG_SPACE(sizeof(int) * 3)];
+    struct iovec iov = {data, len};
+    struct msghdr msg = {0};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    ssize_t n;
+    do {
+        n = recvmsg(sock, &msg, flags | MSG_CMSG_CLOEXEC);
+    } while (n == -1 && errno == EINTR);
+    if (n <= 0) {
+        return -1;
+    }
+    int nfds = 0;
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            int count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            int* received = (int*)CMSG_DATA(cmsg);
+            for (int i = 0; i < count; i++) {
+                if (nfds < max_fds) {
+                    fds[nfds++] = received[i];
+                } else {
+                    close(received[i]);
+                }
+            }
+        }
+    }
+    if ((size_t)n < len && read_full(sock, (char*)data + n, len - n) == -1) {
+        for (int i = 0; i < nfds; i++) {
+            close(fds[i]);
+        }
+        return -1;
+    }
+    return nfds;
+}
+
+// Body of a pre-forked helper. It waits in accept() on the shared listening
+// socket, so the fork and the shell's own startup are already paid for when a
+// request arrives. The helper hands the connection back to the master, then
+// execs the command in place; the master reports its exit status. Only
+// clients running as the server's own user are served.
+void server_helper(int listen_fd, int control_fd) {
+    sigset_t empty_mask;
+    sigemptyset(&empty_mask);
+    sigprocmask(SIG_SETMASK, &empty_mask, NULL);
+    signal(SIGPIPE, SIG_DFL);
+
+    while (1) {
+        int conn_fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (conn_fd == -1) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            perror("server: accept failed");
+            _exit(EXIT_FAILURE);
+        }
+        struct ucred cred;
+        socklen_t cred_len = sizeof(cred);
+        if (getsockopt(conn_fd, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) == -1 || cred.uid != getuid()) {
+            close(conn_fd);
+            continue;
+        }
+
+        ServerRequest req;
+        int fds[3];
+        int nfds = recv_fds(conn_fd, &req, sizeof(req), fds, 3, 0);
+        char* payload = NULL;
+        int valid = (nfds == 3 && req.argc > 0 && req.length > 0 && req.length <= SERVER_MAX_REQUEST);
+        if (valid) {
+            payload = (char*)malloc(req.length);
+            valid = (payload != NULL && read_full(conn_fd, payload, req.length) == 0 && payload[req.length - 1] == '\0');
+        }
+        char** cmd_argv = NULL;
+        char** cmd_envp = NULL;
+        if (valid) {
+            cmd_argv = (char**)malloc(sizeof(char*) * (req.argc + 1));
+            cmd_envp = (char**)malloc(sizeof(char*) * ((size_t)req.envc + 1));
+            valid = (cmd_argv != NULL && cmd_envp != NULL);
+        }
+        uint32_t strings = 0;
+        if (valid) {
+            // Split the payload: cwd, then argc argv strings, then envc env strings
+            char* p = payload + strlen(payload) + 1;
+            char* end = payload + req.length;
+            while (p < end && strings < req.argc + req.envc) {
+                if (strings < req.argc) {
+                    cmd_argv[strings] = p;
+                } else {
+                    cmd_envp[strings - req.argc] = p;
+                }
+                strings++;
+                p += strlen(p) + 1;
+            }
+            valid = (strings == req.argc + req.envc);
+        }
+        if (!valid) {
+            for (int i = 0; i < nfds; i++) {
+                close(fds[i]);
+            }
+            free(payload);
+            free(cmd_argv);
+            free(cmd_envp);
+            close(conn_fd);
+            continue;
+        }
+        cmd_argv[req.argc] = NULL;
+        cmd_envp[req.envc] = NULL;
+
+        pid_t self = getpid();
+        if (send_fds(control_fd, &self, sizeof(self), &conn_fd, 1) == -1) {
+            _exit(EXIT_FAILURE);
+        }
+        close(conn_fd);
+        for (int i = 0; i < 3; i++) {
+            if (dup2(fds[i], i) == -1) {
+                _exit(127);
+            }
+            if (fds[i] > 2) {
+                close(fds[i]);
+            }
+        }
+        if (chdir(payload) == -1) {
+            perror("server: chdir failed");
+            _exit(127);
+        }
+        // execvp searches the PATH in environ, so the command is looked up
+        // with the client's PATH, not the server's
+        environ = cmd_envp;
+        execvp(cmd_argv[0], cmd_argv);
+        perror("execvp failed");
+        _exit(127);
+    }
+}
+
+pid_t server_spawn_helper(int listen_fd, int control_fd) {
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("server: fork failed");
+    } else if (pid == 0) {
+        server_helper(listen_fd, control_fd);
+    }
+    return pid;
+}
+
+// Takes every pending "helper started a job" message off the control socket
+// and forks a replacement for each helper that left the idle pool.
+void server_drain_control(int control_fd, int listen_fd, int helper_fd, pid_t* helpers, int num_helpers,
+                          ServerJob** jobs, int* num_jobs, int* max_jobs) {
+    pid_t pid;
+    int conn_fd;
+    while (recv_fds(control_fd, &pid, sizeof(pid), &conn_fd, 1, MSG_DONTWAIT) == 1) {
+        for (int i = 0; i < num_helpers; i++) {
+            if (helpers[i] == pid) {
+                helpers[i] = server_spawn_helper(listen_fd, helper_fd);
+                break;
+            }
+        }
+        if (*num_jobs == *max_jobs) {
+            *max_jobs = (*max_jobs == 0) ? 16 : *max_jobs * 2;
+            ServerJob* new_jobs = (ServerJob*)realloc(*jobs, sizeof(ServerJob) * *max_jobs);
+            if (new_jobs == NULL) {
+                perror("realloc failed");
+                exit(EXIT_FAILURE);
+            }
+            *jobs = new_jobs;
+        }
+        (*jobs)[*num_jobs].pid = pid;
+        (*jobs)[*num_jobs].conn_fd = conn_fd;
+        (*num_jobs)++;
+    }
+}
+
+// micro_shell --server SOCKET [HELPERS]
+// Serves command requests on a Unix socket from a pool of pre-forked helpers.
+int server_main(const char* socket_path, int num_helpers) {
+    struct sockaddr_un addr = {0};
+    addr.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "server: socket path too long\n");
+        return EXIT_FAILURE;
+    }
+    strcpy(addr.sun_path, socket_path);
+
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd == -1) {
+        perror("server: socket failed");
+        return EXIT_FAILURE;
+    }
+    unlink(socket_path);
+    if (bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)) == -1 || listen(listen_fd, SERVER_BACKLOG) == -1) {
+        perror("server: bind failed");
+        close(listen_fd);
+        return EXIT_FAILURE;
+    }
+
+    int control_fds[2];
+    if (socketpair(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0, control_fds) == -1) {
+        perror("server: socketpair failed");
+        close(listen_fd);
+        unlink(socket_path);
+        return EXIT_FAILURE;
+    }
+
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+    int signal_fd = signalfd(-1, &mask, SFD_CLOEXEC);
+    if (signal_fd == -1) {
+        perror("server: signalfd failed");
+        sigprocmask(SIG_UNBLOCK, &mask, NULL);
+        close(control_fds[0]);
+        close(control_fds[1]);
+        close(listen_fd);
+        unlink(socket_path);
+        return EXIT_FAILURE;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    pid_t* helpers = (pid_t*)malloc(sizeof(pid_t) * num_helpers);
+    if (helpers == NULL) {
+        perror("malloc failed");
+        exit(EXIT_FAILURE);
+    }
+    fflush(stdout);
+    for (int i = 0; i < num_helpers; i++) {
+        helpers[i] = server_spawn_helper(listen_fd, control_fds[1]);
+    }
+    fprintf(stderr, "server: listening on %s with %d helpers\n", socket_path, num_helpers);
+
+    ServerJob* jobs = NULL;
+    int num_jobs = 0;
+    int max_jobs = 0;
+    int running = 1;
+    while (running) {
+        struct pollfd fds[2] = {{control_fds[0], POLLIN, 0}, {signal_fd, POLLIN, 0}};
+        if (poll(fds, 2, -1) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("server: poll failed");
+            break;
+        }
+        server_drain_control(control_fds[0], listen_fd, control_fds[1], helpers, num_helpers,
+                             &jobs, &num_jobs, &max_jobs);
+        if (!(fds[1].revents & POLLIN)) {
+            continue;
+        }
+        struct signalfd_siginfo info;
+        if (read(signal_fd, &info, sizeof(info)) != sizeof(info)) {
+            continue;
+        }
+        if (info.ssi_signo != SIGCHLD) {
+            running = 0;
+            continue;
+        }
+        int status;
+        pid_t pid;
+        while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+            int32_t code = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+            int found = 0;
+            // A helper queues its message before exec, so a reaped pid that is
+            // not a known job yet becomes one after draining the control socket.
+            for (int pass = 0; pass < 2 && !found; pass++) {
+                if (pass == 1) {
+                    server_drain_control(control_fds[0], listen_fd, control_fds[1], helpers, num_helpers,
+                                         &jobs, &num_jobs, &max_jobs);
+                }
+                for (int i = 0; i < num_jobs; i++) {
+                    if (jobs[i].pid == pid) {
+                        write_full(jobs[i].conn_fd, &code, sizeof(code));
+                        close(jobs[i].conn_fd);
+                        jobs[i] = jobs[--num_jobs];
+                        found = 1;
+                        break;
+                    }
+                }
+            }
+            for (int i = 0; !found && i < num_helpers; i++) {
+                if (helpers[i] == pid) {
+                    // An idle helper died; keep the pool at full strength
+                    helpers[i] = server_spawn_helper(listen_fd, control_fds[1]);
+                    break;
+                }
+            }
+        }
+    }
+
+    for (int i = 0; i < num_helpers; i++) {
+        if (helpers[i] > 0) {
+            kill(helpers[i], SIGTERM);
+            waitpid(helpers[i], NULL, 0);
+        }
+    }
+    for (int i = 0; i < num_jobs; i++) {
+        close(jobs[i].conn_fd);
+    }
+    free(jobs);
+    free(helpers);
+    close(signal_fd);
+    close(control_fds[0]);
+    close(control_fds[1]);
+    close(listen_fd);
+    unlink(socket_path);
+    fprintf(stderr, "server: stopped\n");
+    return EXIT_SUCCESS;
+}
+
+// Sends one request to the server and waits for the command's exit status.
+// Returns the status, or -1 when the server could not be reached.
+int client_request(const char* socket_path, char** argv) {
+    struct sockaddr_un addr = {0};
+    addr.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "client: socket path too long\n");
+        return -1;
+    }
+    strcpy(addr.sun_path, socket_path);
+    int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock == -1 || connect(sock, (struct sockaddr*)&addr, sizeof(addr)) == -1) {
+        perror("client: connect failed");
+        if (sock != -1) {
+            close(sock);
+        }
+        return -1;
+    }
+
+    extern char** environ;
+    char* cwd = getcwd(NULL, 0);
+    if (cwd == NULL) {
+        perror("getcwd error");
+        close(sock);
+        return -1;
+    }
+    ServerRequest req = {0, 0, 0};
+    size_t length = strlen(cwd) + 1;
+    for (char** arg = argv; *arg != NULL; arg++) {
+        length += strlen(*arg) + 1;
+        req.argc++;
+    }
+    for (char** env = environ; *env != NULL; env++) {
+        length += strlen(*env) + 1;
+        req.envc++;
+    }
+    req.length = length;
+    char* payload = (char*)malloc(length);
+    if (payload == NULL) {
+        perror("malloc failed");
+        exit(EXIT_FAILURE);
+    }
+    char* p = stpcpy(payload, cwd) + 1;
+    for (char** arg = argv; *arg != NULL; arg++) {
+        p = stpcpy(p, *arg) + 1;
+    }
+    for (char** env = environ; *env != NULL; env++) {
+        p = stpcpy(p, *env) + 1;
+    }
+    free(cwd);
+
+    int std_fds[3] = {0, 1, 2};
+    int32_t status = -1;
+    if (send_fds(sock, &req, sizeof(req), std_fds, 3) == -1 || write_full(sock, payload, length) == -1 ||
+        read_full(sock, &status, sizeof(status)) == -1) {
+        fprintf(stderr, "client: request failed\n");
+        status = -1;
+    }
+    free(payload);
+    close(sock);
+    return status;
+}
+
+// micro_shell --client SOCKET cmd [args...]
+int client_run(const char* socket_path, char** argv) {
+    int status = client_request(socket_path, argv);
+    return (status < 0) ? 127 : status;
+}
+
+int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+void bench_report(const char* label, double* samples, int count) {
+    qsort(samples, count, sizeof(double), compare_doubles);
+    double total = 0;
+    for (int i = 0; i < count; i++) {
+        total += samples[i];
+    }
+    fprintf(stderr, "%-6s n=%d  mean=%.1f us  p50=%.1f us  p99=%.1f us  max=%.1f us\n", label, count,
+            total / count, samples[count / 2], samples[(int)(count * 0.99)], samples[count - 1]);
+}
+
+// micro_shell --bench SOCKET ITERATIONS cmd [args...]
+// Compares request latency through the server against a plain fork+exec+wait.
+int client_bench(const char* socket_path, int iterations, char** argv) {
+    if (iterations < 1) {
+        fprintf(stderr, "bench: iterations must be positive\n");
+        return EXIT_FAILURE;
+    }
+    double* samples = (double*)malloc(sizeof(double) * iterations);
+    if (samples == NULL) {
+        perror("malloc failed");
+        exit(EXIT_FAILURE);
+    }
+    struct timespec start, end;
+
+    for (int i = 0; i < iterations; i++) {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if (client_request(socket_path, argv) < 0) {
+            free(samples);
+            return EXIT_FAILURE;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        samples[i] = (end.tv_sec - start.tv_sec) * 1e6 + (end.tv_nsec - start.tv_nsec) / 1e3;
+    }
+    bench_report("server", samples, iterations);
+
+    for (int i = 0; i < iterations; i++) {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid == -1) {
+            perror("fork failed");
+            free(samples);
+            return EXIT_FAILURE;
+        } else if (pid == 0) {
+            execvp(argv[0], argv);
+            perror("execvp failed");
+            _exit(127);
+        }
+        waitpid(pid, NULL, 0);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        samples[i] = (end.tv_sec - start.tv_sec) * 1e6 + (end.tv_nsec - start.tv_nsec) / 1e3;
+    }
+    bench_report("spawn", samples, iterations);
+
+    free(samples);
+    return EXIT_SUCCESS;
+}
+
+// micro_shell --bench-parse FILE [ITERATIONS]
+// Runs every line of a command corpus (a history file, say) through variable
+// substitution and the parser and reports the cost per line. Assignments are
+// applied once up front, so later lines expand them. Nothing in the corpus is
+// run: command substitutions and globs stay literal (parse_only).
+int parse_bench(const char* path, int iterations) {
+    parse_only = 1;
+    FILE* corpus = fopen(path, "r");
+    if (corpus == NULL) {
+        perror("bench: open corpus failed");
+        return EXIT_FAILURE;
+    }
+    char** lines = NULL;
+    int num_lines = 0;
+    int max_lines = 0;
+    size_t longest = 0;
+    char* line = NULL;
+    size_t line_capacity = 0;
+    ssize_t length;
+    while ((length = getline(&line, &line_capacity, corpus)) != -1) {
+        line[strcspn(line, "\n")] = '\0';
+        if (is_valid_assignment(line)) {
+            char* eq_ptr = strchr(line, '=');
+            *eq_ptr = '\0';
+            add_shell_var(line, eq_ptr + 1);
+            continue;
+        }
+        if (num_lines == max_lines) {
+            max_lines = (max_lines == 0) ? 1024 : max_lines * 2;
+            char** new_lines = (char**)realloc(lines, sizeof(char*) * max_lines);
+            if (new_lines == NULL) {
+                perror("realloc failed");
+                exit(EXIT_FAILURE);
+            }
+            lines = new_lines;
+        }
+        lines[num_lines] = strdup(line);
+        if (lines[num_lines] == NULL) {
+            perror("strdup failed");
+            exit(EXIT_FAILURE);
+        }
+        if ((size_t)length > longest) {
+            longest = length;
+        }
+        num_lines++;
+    }
+    free(line);
+    fclose(corpus);
+    if (num_lines == 0 || iterations < 1) {
+        fprintf(stderr, "bench: nothing to parse\n");
+        free(lines);
+        return EXIT_FAILURE;
+    }
+
+    // parse_input tokenizes in place, so each round works on a scratch copy
+    char* scratch = (char*)malloc(longest + 1);
+    if (scratch == NULL) {
+        perror("malloc failed");
+        exit(EXIT_FAILURE);
+    }
+    long args = 0;
+    struct timespec start, end;
+#ifdef MICRO_SHELL_ALLOC_COUNT
+    unsigned long allocs_before = alloc_count;
+#endif
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < iterations; i++) {
+        for (int j = 0; j < num_lines; j++) {
+            strcpy(scratch, lines[j]);
+            char* substituted_input = substitute_variables(scratch);
+            int argc;
+            RedirectionInfo redir_info = {0};
+            char** argv = parse_input(substituted_input, &argc, &redir_info);
+            free(substituted_input);
+            args += argc;
+            free_arguments(argv, argc);
+            free_redirection_info(&redir_info);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double total_ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+    long parsed = (long)num_lines * iterations;
+    fprintf(stderr, "parse: %d lines x %d  %.1f ns/line  %.2f args/line", num_lines, iterations,
+            total_ns / parsed, (double)args / parsed);
+#ifdef MICRO_SHELL_ALLOC_COUNT
+    fprintf(stderr, "  %.2f allocs/line", (double)(alloc_count - allocs_before) / parsed);
+#endif
+    fprintf(stderr, "\n");
+
+    for (int j = 0; j < num_lines; j++) {
+        free(lines[j]);
+    }
+    free(lines);
+    free(scratch);
+    free_shell_vars();
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,53 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "my_utils.h"
+
+// Multi-call binary: every utility in one executable, selected by the name it
+// is invoked as (e.g. a my_cp symlink to my_box) or by its first argument.
+static const MyUtility my_utilities[] = {
+    {"my_cp", my_cp_main},
+    {"my_echo", my_echo_main},
+    {"my_mv", my_mv_main},
+    {"my_pwd", my_pwd_main},
+};
+
+const MyUtility *find_my_utility(const char *name)
+{
+    for (size_t i = 0; i < sizeof(my_utilities) / sizeof(my_utilities[0]); i++)
+    {
+        if (strcmp(my_utilities[i].name, name) == 0)
+        {
+            return &my_utilities[i];
+        }
+    }
+    return NULL;
+}
+
+#ifndef MY_BOX_NO_MAIN
+int main(int argc, char *argv[])
+{
+    const char *name = strrchr(argv[0], '/');
+    name = (name != NULL) ? name + 1 : argv[0];
+
+    const MyUtility *utility = find_my_utility(name);
+    if (utility == NULL && argc > 1)
+    {
+        // Invoked as "my_box my_cp ..."
+        utility = find_my_utility(argv[1]);
+        argc--;
+        argv++;
+    }
+    if (utility == NULL)
+    {
+        fprintf(stderr, "Usage: my_box <utility> [arguments]\nUtilities:");
+        for (size_t i = 0; i < sizeof(my_utilities) / sizeof(my_utilities[0]); i++)
+        {
+            fprintf(stderr, " %s", my_utilities[i].name);
+        }
+        fprintf(stderr, "\n");
+        return EXIT_FAILURE;
+    }
+    return utility->main(argc, argv);
+}
+#endif
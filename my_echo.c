@@ -1,25 +1,24 @@
-#include <stdio.h>
-#include <stdlib.h>                                                                                                                                         #include <unistd.h>                                                                                                                                                                                                                                                                                                     #define PATH_MAX 100
-
-int main(int argc, char *argv[])
-{
-    if(argc < 2)
-    {
-        // No arguments provided, just print a newline
-        printf("\n");
-    }
-    else
-    {
-        for(int i = 1; i < argc;i++)
-        {
-            printf("%s",argv[i]);
-            // Add a space between arguments, except for the last one
-            if (i < (argc - 1))
-            {
-                printf(" ");
-            }
-        }
-        printf("\n"); // Add a newline at the end
-    }
-    return EXIT_SUCCESS;
-}
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "my_utils.h"
+#include "output_vec.h"
+
+// Prints the arguments separated by spaces (see output_echo for -n, -e and -E).
+// All of it goes out in a single writev.
+int my_echo_main(int argc, char *argv[])
+{
+    if (output_echo(stdout, argv, argc) == -1)
+    {
+        perror("my_echo: write failed");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+#ifndef MY_UTILS_NO_MAIN
+int main(int argc, char *argv[])
+{
+    return my_echo_main(argc, argv);
+}
+#endif
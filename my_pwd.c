@@ -1,13 +1,73 @@
-#include <stdio.h>
-#include <stdlib.h>                                                                                                                                         #include <unistd.h>                                                                                                                                                                                                                                                                                                     #define PATH_MAX 100
-
-int main()
-{
-    char cwd[PATH_MAX];
-    if ((getcwd(cwd, PATH_MAX)) != NULL) {
-        printf("%s\n", cwd); // Success                                                                                                                                        exit(0); // Success
-    } else {                                                                                                                                                        printf("Error: Could not get current working directory");
-        return EXIT_FAILURE; // Failure
-    }
-    return EXIT_SUCCESS;
-}
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include "my_utils.h"
+
+// $PWD when it is an absolute path naming the current directory, without
+// "." or ".." components; it is printed as is, like the shell's logical pwd
+static int pwd_is_valid(const char* pwd)
+{
+    struct stat pwd_stat, dot_stat;
+    if (pwd == NULL || pwd[0] != '/' || strstr(pwd, "/./") != NULL || strstr(pwd, "/../") != NULL)
+    {
+        return 0;
+    }
+    size_t len = strlen(pwd);
+    if ((len >= 2 && strcmp(pwd + len - 2, "/.") == 0) || (len >= 3 && strcmp(pwd + len - 3, "/..") == 0))
+    {
+        return 0;
+    }
+    return stat(pwd, &pwd_stat) == 0 && stat(".", &dot_stat) == 0 && pwd_stat.st_dev == dot_stat.st_dev &&
+           pwd_stat.st_ino == dot_stat.st_ino;
+}
+
+int my_pwd_main(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+    char* pwd = getenv("PWD");
+    if (pwd_is_valid(pwd))
+    {
+        printf("%s\n", pwd);
+        return EXIT_SUCCESS;
+    }
+
+    // The buffer grows until the path fits, so there is no length limit
+    size_t size = 256;
+    char* cwd = NULL;
+    while (1)
+    {
+        char* new_cwd = (char*)realloc(cwd, size);
+        if (new_cwd == NULL)
+        {
+            free(cwd);
+            perror("realloc failed");
+            return EXIT_FAILURE;
+        }
+        cwd = new_cwd;
+        if (getcwd(cwd, size) != NULL)
+        {
+            break;
+        }
+        if (errno != ERANGE)
+        {
+            free(cwd);
+            printf("Error: Could not get current working directory");
+            return EXIT_FAILURE; // Failure
+        }
+        size *= 2;
+    }
+    printf("%s\n", cwd); // Success
+    free(cwd);
+    return EXIT_SUCCESS;
+}
+
+#ifndef MY_UTILS_NO_MAIN
+int main(int argc, char *argv[])
+{
+    return my_pwd_main(argc, argv);
+}
+#endif
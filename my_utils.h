@@ -0,0 +1,22 @@
+#ifndef MY_UTILS_H
+#define MY_UTILS_H
+
+// Library entry points of the my_* utilities. Each file still builds into its
+// own program; compiled with -DMY_UTILS_NO_MAIN the files only provide these
+// functions, so they can be linked into my_box or run in-process by a shell.
+int my_cp_main(int argc, char *argv[]);
+int my_echo_main(int argc, char *argv[]);
+int my_mv_main(int argc, char *argv[]);
+int my_pwd_main(int argc, char *argv[]);
+
+// One utility that can be dispatched by name
+typedef struct
+{
+    const char *name;
+    int (*main)(int argc, char *argv[]);
+} MyUtility;
+
+// Returns the utility called name, or NULL (defined in my_box.c)
+const MyUtility *find_my_utility(const char *name);
+
+#endif
@@ -0,0 +1,193 @@
+#ifndef OUTPUT_VEC_H
+#define OUTPUT_VEC_H
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+// Output layer for builtins and utilities that print many small pieces: the
+// pieces are gathered as iovecs and written with one writev, so echo with
+// many arguments or printenv of a large environment is a single syscall.
+// Pieces are referenced, not copied, and must stay valid until the flush;
+// bytes made up on the fly (escape sequences) go to a small scratch buffer.
+
+#define OUTPUT_VEC_MAX 1024 // IOV_MAX on Linux
+#define OUTPUT_SCRATCH_SIZE 4096
+
+typedef struct {
+    FILE* file; // flushed first, so earlier stdio output stays in order
+    struct iovec iov[OUTPUT_VEC_MAX];
+    int count;
+    char scratch[OUTPUT_SCRATCH_SIZE];
+    size_t scratch_used;
+    int failed;
+} OutputVec;
+
+static inline void output_init(OutputVec* out, FILE* file) {
+    out->file = file;
+    out->count = 0;
+    out->scratch_used = 0;
+    out->failed = 0;
+}
+
+// Writes everything gathered so far. writev may write only part of it, or be
+// interrupted, so it is called again on what is left. A stream without an fd
+// (a memory stream capturing a builtin's output) gets the pieces by fwrite.
+// Returns -1 once any write failed.
+static inline int output_flush(OutputVec* out) {
+    struct iovec* iov = out->iov;
+    int count = out->count;
+    int fd = fileno(out->file);
+    fflush(out->file);
+    if (fd == -1) {
+        for (int i = 0; i < count; i++) {
+            if (fwrite(iov[i].iov_base, 1, iov[i].iov_len, out->file) != iov[i].iov_len) {
+                out->failed = 1;
+            }
+        }
+        count = 0;
+    }
+    while (count > 0) {
+        ssize_t n = writev(fd, iov, count);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            out->failed = 1;
+            break;
+        }
+        while (count > 0 && (size_t)n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char*)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    out->count = 0;
+    out->scratch_used = 0;
+    return out->failed ? -1 : 0;
+}
+
+// Queues len bytes at data, which must stay valid until the next flush
+static inline void output_add(OutputVec* out, const void* data, size_t len) {
+    if (len == 0) {
+        return;
+    }
+    if (out->count == OUTPUT_VEC_MAX) {
+        output_flush(out);
+    }
+    out->iov[out->count].iov_base = (void*)data;
+    out->iov[out->count].iov_len = len;
+    out->count++;
+}
+
+static inline void output_add_string(OutputVec* out, const char* text) {
+    output_add(out, text, strlen(text));
+}
+
+// Queues one byte through the scratch buffer, merging it with the previous
+// byte when that one came from the scratch buffer too
+static inline void output_add_byte(OutputVec* out, char c) {
+    if (out->scratch_used == OUTPUT_SCRATCH_SIZE || out->count == OUTPUT_VEC_MAX) {
+        // Flushing here, not inside output_add, so the byte is never queued
+        // and then overwritten by a reused scratch buffer
+        output_flush(out);
+    }
+    char* p = out->scratch + out->scratch_used++;
+    *p = c;
+    if (out->count > 0 && (char*)out->iov[out->count - 1].iov_base + out->iov[out->count - 1].iov_len == p) {
+        out->iov[out->count - 1].iov_len++;
+    } else {
+        output_add(out, p, 1);
+    }
+}
+
+// Queues text with echo -e backslash escapes decoded. Returns 0 when a \c
+// asked for no further output.
+static inline int output_add_escaped(OutputVec* out, const char* text) {
+    const char* p = text;
+    while (*p != '\0') {
+        // Plain runs are referenced in place
+        size_t span = strcspn(p, "\\");
+        output_add(out, p, span);
+        p += span;
+        if (*p == '\0') {
+            break;
+        }
+        p++;
+        switch (*p) {
+        case 'a': output_add_byte(out, '\a'); break;
+        case 'b': output_add_byte(out, '\b'); break;
+        case 'e': output_add_byte(out, '\033'); break;
+        case 'f': output_add_byte(out, '\f'); break;
+        case 'n': output_add_byte(out, '\n'); break;
+        case 'r': output_add_byte(out, '\r'); break;
+        case 't': output_add_byte(out, '\t'); break;
+        case 'v': output_add_byte(out, '\v'); break;
+        case '\\': output_add_byte(out, '\\'); break;
+        case 'c': return 0;
+        case '0': {
+            // \0nnn: up to three octal digits
+            int value = 0;
+            int digits = 0;
+            while (digits < 3 && p[1] >= '0' && p[1] <= '7') {
+                value = value * 8 + (*++p - '0');
+                digits++;
+            }
+            output_add_byte(out, (char)value);
+            break;
+        }
+        case '\0':
+            output_add_byte(out, '\\');
+            return 1;
+        default:
+            output_add_byte(out, '\\');
+            output_add_byte(out, *p);
+            break;
+        }
+        p++;
+    }
+    return 1;
+}
+
+// echo [-neE] [args...]: the arguments separated by single spaces, then a
+// newline unless -n; -e decodes backslash escapes, -E (the default) does not.
+// Option words are only taken while every letter in them is one of n, e, E.
+static inline int output_echo(FILE* file, char** argv, int argc) {
+    OutputVec out;
+    output_init(&out, file);
+    int newline = 1;
+    int escapes = 0;
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-' && argv[i][1] != '\0' && strspn(argv[i] + 1, "neE") == strlen(argv[i] + 1); i++) {
+        for (const char* flag = argv[i] + 1; *flag != '\0'; flag++) {
+            if (*flag == 'n') {
+                newline = 0;
+            } else {
+                escapes = (*flag == 'e');
+            }
+        }
+    }
+    for (int first = i; i < argc; i++) {
+        if (i > first) {
+            output_add(&out, " ", 1);
+        }
+        if (!escapes) {
+            output_add_string(&out, argv[i]);
+        } else if (!output_add_escaped(&out, argv[i])) {
+            newline = 0;
+            break;
+        }
+    }
+    if (newline) {
+        output_add(&out, "\n", 1);
+    }
+    return output_flush(&out);
+}
+
+#endif
@@ -0,0 +1,2300 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <stdint.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <sys/syscall.h>
+#include <sched.h>
+#include <limits.h>
+#include <sys/mman.h>
+#ifdef WITH_MY_UTILS
+#include "my_utils.h"
+#endif
+#include "shell_core.h"
+#include "output_vec.h"
+
+// Command parsing and execution shared by the pico, nano and micro shells.
+// What gets compiled in is chosen by SHELL_LEVEL (see shell_core.h).
+
+#define GLOB_DENTS_BUFFER (256 * 1024)
+
+// Global array to store shell variables
+ShellVar* shellVars = NULL;
+int numShellVars = 0;
+int maxShellVars = 0;
+
+char* shell_pwd = NULL;
+char* shell_oldpwd = NULL;
+
+char** shell_envp = NULL;
+int num_env = 0;
+int max_env = 0;
+
+int last_exit_status = 0;
+int parse_only = 0;
+int stdin_redirected = 0;
+RedirectionInfo* builtin_redirections = NULL;
+int trace_fd = -1;
+CommandStats* active_stats = NULL;
+
+#if SHELL_LEVEL >= SHELL_LEVEL_NANO
+// Each input line after substitution. Kept from line to line, so a command
+// does not allocate it again; dropped back to MAX_INPUT after a huge line.
+StringBuffer line_buffer = {NULL, 0, 0};
+#define LINE_BUFFER_KEEP (64 * 1024)
+#endif
+
+#if SHELL_LEVEL >= SHELL_LEVEL_MICRO
+// One element of a compiled glob pattern
+typedef enum {
+    GLOB_LITERAL,
+    GLOB_ANY,   // ?
+    GLOB_STAR,  // *
+    GLOB_CLASS  // [...], negation folded into the bitmap
+} GlobOpType;
+
+typedef struct {
+    GlobOpType type;
+    char c;                // GLOB_LITERAL
+    unsigned char set[32]; // GLOB_CLASS: one bit per byte value
+} GlobOp;
+
+// A path segment compiled once, then matched against every directory entry
+typedef struct {
+    GlobOp* ops;
+    int count;
+    int match_dotfiles; // pattern starts with '.'
+} GlobPattern;
+
+// Layout of the records returned by getdents64
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+int glob_expand(const char* pattern, char*** argv, int* argc, int* capacity);
+
+// Entry of the pushd/popd stack: an O_PATH descriptor of the directory, so
+// going back is one fchdir, and its logical path
+typedef struct {
+    int fd;
+    char* path;
+} DirStackEntry;
+
+DirStackEntry* dir_stack = NULL;
+int dir_stack_size = 0;
+int dir_stack_capacity = 0;
+
+// Resource controls given as @key=value words before a command. The child
+// applies them between fork and exec, so they cost no helper process.
+typedef struct {
+    int active;
+    int has_cpus;
+    cpu_set_t cpus;   // @cpus=0-3,8
+    int has_nice;
+    int nice;         // @nice=N, the absolute niceness
+    int has_sched;
+    int sched_policy; // @sched=other|batch|idle
+    rlim_t mem;       // @mem=SIZE, RLIMIT_AS; 0 when unset
+    rlim_t fds;       // @fds=N, RLIMIT_NOFILE; 0 when unset
+    char cgroup[1024]; // @cgroup=PATH, cgroup v2 directory to join; "" when unset
+} JobLimits;
+
+// Limits of the command being dispatched, NULL when it has none
+JobLimits* active_limits = NULL;
+
+ssize_t (*read_continuation_line)(char** line, size_t* capacity) = read_stdin_line;
+
+int take_job_limits(char** argv, int* argc, JobLimits* limits);
+int apply_job_limits(const JobLimits* limits);
+#endif
+
+// Builtin table generated from shell_builtins.def; needs the builtin_*
+// prototypes from shell_core.h
+#include "shell_builtins.h"
+
+// Runs one line of input: a variable assignment, or a command after its
+// variables are substituted. Leading NAME=value words of a command set those
+// variables in its environment only.
+void shell_execute_line(char* input) {
+#if SHELL_LEVEL >= SHELL_LEVEL_NANO
+    // Check for variable assignment
+    if (is_valid_assignment(input)) {
+        char* eq_ptr = strchr(input, '=');
+        *eq_ptr = '\0';
+        add_shell_var(input, substitute_line(eq_ptr + 1));
+        return;
+    }
+
+    char* substituted_input = substitute_line(input);
+#else
+    char* substituted_input = input;
+#endif
+    int argc;
+    RedirectionInfo redir_info = {0};
+    char** argv = parse_input(substituted_input, &argc, &redir_info);
+#if SHELL_LEVEL >= SHELL_LEVEL_MICRO
+    // The body follows the line, so it is read even if the command fails
+    if (redir_info.here_delimiter != NULL) {
+        read_here_document(&redir_info);
+    }
+    JobLimits limits;
+    if (take_job_limits(argv, &argc, &limits) == -1) {
+        last_exit_status = 1;
+        free_arguments(argv, argc);
+        free_redirection_info(&redir_info);
+        return;
+    }
+    JobLimits* outer_limits = active_limits;
+    if (limits.active) {
+        active_limits = &limits;
+    }
+#endif
+#if SHELL_LEVEL >= SHELL_LEVEL_NANO
+
+    int num_assignments = 0;
+    while (num_assignments < argc && is_assignment_word(argv[num_assignments])) {
+        num_assignments++;
+    }
+    if (num_assignments > 0 && num_assignments == argc) {
+        // Only assignments: they set shell variables
+        for (int i = 0; i < argc; i++) {
+            char* eq_ptr = strchr(argv[i], '=');
+            *eq_ptr = '\0';
+            add_shell_var(argv[i], eq_ptr + 1);
+            *eq_ptr = '=';
+        }
+    } else if (num_assignments > 0) {
+        // Owned first, so an export run by the command changes the shell's
+        // environment and not the overlay
+        env_own();
+        char** envp = env_overlay(argv, num_assignments);
+        environ = envp;
+        dispatch_command(argv + num_assignments, argc - num_assignments, &redir_info);
+        environ = shell_envp;
+        free(envp);
+    } else
+#endif
+    if (argc > 0) {
+        dispatch_command(argv, argc, &redir_info);
+    }
+#if SHELL_LEVEL >= SHELL_LEVEL_MICRO
+    active_limits = outer_limits;
+#endif
+    free_arguments(argv, argc);
+    free_redirection_info(&redir_info);
+}
+
+char** parse_input(char* input, int* argc, RedirectionInfo* redir_info) {
+    int capacity = MAX_ARGS;
+    char** argv = (char**)malloc(sizeof(char*) * (capacity + 1));
+    if (argv == NULL) {
+        perror("malloc failed");
+        exit(EXIT_FAILURE);
+    }
+
+    char* token = strtok(input, DELIMITERS);
+    *argc = 0;
+#if SHELL_LEVEL >= SHELL_LEVEL_MICRO
+    int redirection_mode = 0; // 0: normal, 1: input, 2: output, 3: error, 4: "<<<", 5: "<<"
+#endif
+
+    while (token != NULL) {
+#if SHELL_LEVEL >= SHELL_LEVEL_MICRO
+        if (strcmp(token, "<") == 0) {
+            redirection_mode = 1;
+        } else if (strncmp(token, "<<<", 3) == 0) {
+            // Here-string: the word (given separately or attached) and a newline
+            redirection_mode = 4;
+            if (token[3] != '\0') {
+                set_here_word(token + 3, 4, redir_info);
+                redirection_mode = 0;
+            }
+        } else if (strncmp(token, "<<", 2) == 0) {
+            // Here-document: the body is read after the line by shell_execute_line
+            redir_info->here_strip_tabs = (token[2] == '-');
+            char* word = token + 2 + redir_info->here_strip_tabs;
+            redirection_mode = 5;
+            if (*word != '\0') {
+                set_here_word(word, 5, redir_info);
+                redirection_mode = 0;
+            }
+        } else if (strcmp(token, ">") == 0 || strcmp(token, ">>") == 0) {
+            redir_info->append_output = (token[1] == '>');
+            if (redir_info->error_to_output) {
+                redir_info->error_to_output = ERROR_TO_OUTPUT_BEFORE;
+            }
+            redirection_mode = 2;
+        } else if (strcmp(token, "2>") == 0 || strcmp(token, "2>>") == 0) {
+            // A later "2>" overrides an earlier "2>&1"
+            redir_info->append_error = (token[2] == '>');
+            redir_info->error_to_output = 0;
+            redirection_mode = 3;
+        } else if (strcmp(token, "2>&1") == 0) {
+            redir_info->error_to_output = ERROR_TO_OUTPUT_AFTER;
+        } else if (redirection_mode == 1) {
+            free(redir_info->input_file);
+            redir_info->input_file = strdup(token);
+            free(redir_info->here_body);
+            redir_info->here_body = NULL;
+            redirection_mode = 0;
+        } else if (redirection_mode >= 4) {
+            set_here_word(token, redirection_mode, redir_info);
+            redirection_mode = 0;
+        } else if (redirection_mode == 2) {
+            free(redir_info->output_file);
+            redir_info->output_file = strdup(token);
+            redirection_mode = 0;
+        } else if (redirection_mode == 3) {
+            free(redir_info->error_file);
+            redir_info->error_file = strdup(token);
+            redirection_mode = 0;
+        } else if (!parse_only && strpbrk(token, "*?[") != NULL) {
+            // The pattern's matches, or the unescaped word when none
+            glob_expand(token, &argv, argc, &capacity);
+        } else
+#endif
+        {
+            // Not a pattern, or a pattern without matches: kept literally
+            char* arg = strdup(token);
+            if (arg == NULL) {
+                perror("malloc failed");
+                exit(EXIT_FAILURE);
+            }
+            add_argument(&argv, argc, &capacity, arg);
+        }
+
+        token = strtok(NULL, DELIMITERS);
+    }
+    argv[*argc] = NULL;
+    return argv;
+}
+
+// Appends arg (taken over) to argv, growing it as needed; argv always has
+// room for the terminating NULL.
+void add_argument(char*** argv, int* argc, int* capacity, char* arg) {
+    if (*argc == *capacity) {
+        *capacity *= 2;
+        char** new_argv = (char**)realloc(*argv, sizeof(char*) * (*capacity + 1));
+        if (new_argv == NULL) {
+            perror("realloc failed");
+            exit(EXIT_FAILURE);
+        }
+        *argv = new_argv;
+    }
+    (*argv)[(*argc)++] = arg;
+}
+
+#if SHELL_LEVEL >= SHELL_LEVEL_MICRO
+int glob_has_magic(const char* segment) {
+    for (const char* p = segment; *p != '\0'; p++) {
+        if (*p == '\\' && p[1] != '\0') {
+            p++;
+        } else if (*p == '*' || *p == '?' || *p == '[') {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Compiles one path segment; a '[' without a closing ']' is a literal.
+void glob_compile(const char* segment, GlobPattern* pattern) {
+    pattern->ops = (GlobOp*)malloc(sizeof(GlobOp) * (strlen(segment) + 1));
+    if (pattern->ops == NULL) {
+        perror("malloc failed");
+        exit(EXIT_FAILURE);
+    }
+    pattern->count = 0;
+    pattern->match_dotfiles = (segment[0] == '.');
+    for (const char* p = segment; *p != '\0'; p++) {
+        GlobOp* op = &pattern->ops[pattern->count];
+        if (*p == '*') {
+            if (pattern->count > 0 && pattern->ops[pattern->count - 1].type == GLOB_STAR) {
+                continue;
+            }
+            op->type = GLOB_STAR;
+        } else if (*p == '?') {
+            op->type = GLOB_ANY;
+        } else if (*p == '[' && p[1] != '\0' && strchr(p + 2, ']') != NULL) {
+            const char* q = p + 1;
+            int negate = (*q == '!' || *q == '^');
+            if (negate) {
+                q++;
+            }
+            memset(op->set, 0, sizeof(op->set));
+            // A ']' right after the '[' (or '[!') is part of the set
+            do {
+                unsigned char first = (unsigned char)*q;
+                unsigned char last = first;
+                if (q[1] == '-' && q[2] != ']' && q[2] != '\0') {
+                    last = (unsigned char)q[2];
+                    q += 2;
+                }
+                for (int c = first; c <= last; c++) {
+                    op->set[c >> 3] |= 1 << (c & 7);
+                }
+                q++;
+            } while (*q != ']' && *q != '\0');
+            if (*q == '\0') {
+                op->type = GLOB_LITERAL;
+                op->c = '[';
+            } else {
+                if (negate) {
+                    for (int i = 0; i < 32; i++) {
+                        op->set[i] = ~op->set[i];
+                    }
+                }
+                op->type = GLOB_CLASS;
+                p = q;
+            }
+        } else {
+            if (*p == '\\' && p[1] != '\0') {
+                p++;
+            }
+            op->type = GLOB_LITERAL;
+            op->c = *p;
+        }
+        pattern->count++;
+    }
+}
+
+// Matches name against a compiled pattern, backtracking only to the last '*'.
+int glob_match(const GlobPattern* pattern, const char* name) {
+    if (name[0] == '.' && !pattern->match_dotfiles) {
+        return 0;
+    }
+    int op = 0;
+    int star = -1;
+    const char* star_name = NULL;
+    while (*name != '\0') {
+        if (op < pattern->count) {
+            const GlobOp* current = &pattern->ops[op];
+            unsigned char c = (unsigned char)*name;
+            if (current->type == GLOB_STAR) {
+                star = op++;
+                star_name = name;
+                continue;
+            }
+            if (current->type == GLOB_ANY || (current->type == GLOB_LITERAL && current->c == *name) ||
+                (current->type == GLOB_CLASS && (current->set[c >> 3] & (1 << (c & 7))))) {
+                op++;
+                name++;
+                continue;
+            }
+        }
+        if (star == -1) {
+            return 0;
+        }
+        op = star + 1;
+        name = ++star_name;
+    }
+    while (op < pattern->count && pattern->ops[op].type == GLOB_STAR) {
+        op++;
+    }
+    return op == pattern->count;
+}
+
+// Joins a directory path and a name into a new string.
+char* glob_join(const char* dir, const char* name) {
+    size_t dir_len = strlen(dir);
+    char* path = (char*)malloc(dir_len + strlen(name) + 2);
+    if (path == NULL) {
+        perror("malloc failed");
+        exit(EXIT_FAILURE);
+    }
+    if (dir_len == 0) {
+        strcpy(path, name);
+    } else if (dir[dir_len - 1] == '/') {
+        sprintf(path, "%s%s", dir, name);
+    } else {
+        sprintf(path, "%s/%s", dir, name);
+    }
+    return path;
+}
+
+// Lists a directory with large getdents64 batches. Entries are kept when
+// pattern (if any) matches them and, for dirs_only, when they are directories;
+// d_type avoids a stat per entry except on filesystems that do not fill it.
+int glob_read_dir(const char* dir, const GlobPattern* pattern, int dirs_only, char*** names, int* count) {
+    static char* buffer = NULL;
+    if (buffer == NULL) {
+        buffer = (char*)malloc(GLOB_DENTS_BUFFER);
+        if (buffer == NULL) {
+            perror("malloc failed");
+            exit(EXIT_FAILURE);
+        }
+    }
+    int fd = open(*dir != '\0' ? dir : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1) {
+        return -1;
+    }
+    int capacity = 0;
+    *names = NULL;
+    *count = 0;
+    long n;
+    while ((n = syscall(SYS_getdents64, fd, buffer, GLOB_DENTS_BUFFER)) > 0) {
+        for (long offset = 0; offset < n;) {
+            struct linux_dirent64* entry = (struct linux_dirent64*)(buffer + offset);
+            offset += entry->d_reclen;
+            const char* name = entry->d_name;
+            if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+                continue;
+            }
+            if (pattern != NULL ? !glob_match(pattern, name) : name[0] == '.') {
+                continue;
+            }
+            if (dirs_only && entry->d_type != DT_DIR) {
+                struct stat st;
+                if (entry->d_type != DT_UNKNOWN && entry->d_type != DT_LNK) {
+                    continue;
+                }
+                if (fstatat(fd, name, &st, 0) == -1 || !S_ISDIR(st.st_mode)) {
+                    continue;
+                }
+            }
+            if (*count == capacity) {
+                capacity = (capacity == 0) ? 64 : capacity * 2;
+                char** new_names = (char**)realloc(*names, sizeof(char*) * capacity);
+                if (new_names == NULL) {
+                    perror("realloc failed");
+                    exit(EXIT_FAILURE);
+                }
+                *names = new_names;
+            }
+            (*names)[(*count)++] = strdup(name);
+        }
+    }
+    close(fd);
+    return 0;
+}
+
+// Adds a match to argv; with dirs_only (a pattern ending in '/') the match
+// keeps the trailing '/'
+void glob_add_match(const char* path, int dirs_only, char*** argv, int* argc, int* capacity) {
+    add_argument(argv, argc, capacity, dirs_only ? glob_join(path, "") : strdup(path));
+}
+
+// Expands segments[index..] below dir, adding every existing match to argv.
+// patterns[i] is segment i compiled by glob_expand, with no ops for "**" and
+// for literal segments (already unescaped). dirs_only keeps only directories,
+// for a pattern ending in '/'.
+void glob_walk(const char* dir, char** segments, const GlobPattern* patterns, int num_segments, int index,
+               int dirs_only, char*** argv, int* argc, int* capacity) {
+    if (index == num_segments) {
+        struct stat st;
+        if (!dirs_only || (stat(dir, &st) == 0 && S_ISDIR(st.st_mode))) {
+            glob_add_match(dir, dirs_only, argv, argc, capacity);
+        }
+        return;
+    }
+    const char* segment = segments[index];
+    int last = (index == num_segments - 1);
+    char** names;
+    int count;
+
+    if (strcmp(segment, "**") == 0) {
+        // "**" matches zero or more directory levels; a final "**" matches
+        // everything below dir, files and directories, but not dir itself
+        if (!last) {
+            glob_walk(dir, segments, patterns, num_segments, index + 1, dirs_only, argv, argc, capacity);
+        }
+        if (glob_read_dir(dir, NULL, !last || dirs_only, &names, &count) == 0) {
+            for (int i = 0; i < count; i++) {
+                char* path = glob_join(dir, names[i]);
+                struct stat st;
+                int is_dir = (lstat(path, &st) == 0 && S_ISDIR(st.st_mode));
+                if (last) {
+                    glob_add_match(path, dirs_only, argv, argc, capacity);
+                }
+                if (is_dir) {
+                    glob_walk(path, segments, patterns, num_segments, index, dirs_only, argv, argc, capacity);
+                }
+                free(path);
+                free(names[i]);
+            }
+            free(names);
+        }
+        return;
+    }
+
+    if (patterns[index].ops == NULL) {
+        char* path = glob_join(dir, segment);
+        if (!last || access(path, F_OK) == 0) {
+            glob_walk(path, segments, patterns, num_segments, index + 1, dirs_only, argv, argc, capacity);
+        }
+        free(path);
+        return;
+    }
+
+    if (glob_read_dir(dir, &patterns[index], !last || dirs_only, &names, &count) == 0) {
+        for (int i = 0; i < count; i++) {
+            char* path = glob_join(dir, names[i]);
+            if (last) {
+                glob_add_match(path, dirs_only, argv, argc, capacity);
+            } else {
+                glob_walk(path, segments, patterns, num_segments, index + 1, dirs_only, argv, argc, capacity);
+            }
+            free(path);
+            free(names[i]);
+        }
+        free(names);
+    }
+}
+
+// Removes backslash escapes in place
+void glob_unescape(char* text) {
+    char* out = text;
+    for (const char* p = text; *p != '\0'; p++) {
+        if (*p == '\\' && p[1] != '\0') {
+            p++;
+        }
+        *out++ = *p;
+    }
+    *out = '\0';
+}
+
+int compare_arguments(const void* a, const void* b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+// Pathname expansion of one word (*, ?, [...] and **). Matches are appended to
+// argv in sorted order; without a match the word itself is, with its escapes
+// removed. Returns how many matches were added. Each segment is compiled (or
+// unescaped, when it has no magic) once, however many directories the walk
+// visits.
+int glob_expand(const char* pattern, char*** argv, int* argc, int* capacity) {
+    char* copy = strdup(pattern);
+    size_t max_segments = strlen(pattern) + 1;
+    char** segments = (char**)malloc(sizeof(char*) * max_segments);
+    GlobPattern* patterns = (GlobPattern*)calloc(max_segments, sizeof(GlobPattern));
+    if (copy == NULL || segments == NULL || patterns == NULL) {
+        perror("malloc failed");
+        exit(EXIT_FAILURE);
+    }
+    int num_segments = 0;
+    char* save = NULL;
+    for (char* segment = strtok_r(copy, "/", &save); segment != NULL; segment = strtok_r(NULL, "/", &save)) {
+        if (glob_has_magic(segment)) {
+            if (strcmp(segment, "**") != 0) {
+                glob_compile(segment, &patterns[num_segments]);
+            }
+        } else {
+            glob_unescape(segment);
+        }
+        segments[num_segments++] = segment;
+    }
+    // strtok_r drops a trailing '/', which asks for directories only
+    size_t length = strlen(pattern);
+    int dirs_only = (length > 1 && pattern[length - 1] == '/');
+    int first = *argc;
+    glob_walk(pattern[0] == '/' ? "/" : "", segments, patterns, num_segments, 0, dirs_only, argv, argc, capacity);
+    int matches = *argc - first;
+    qsort(*argv + first, matches, sizeof(char*), compare_arguments);
+    if (matches == 0) {
+        char* literal = strdup(pattern);
+        if (literal == NULL) {
+            perror("malloc failed");
+            exit(EXIT_FAILURE);
+        }
+        glob_unescape(literal);
+        add_argument(argv, argc, capacity, literal);
+    }
+    for (int i = 0; i < num_segments; i++) {
+        free(patterns[i].ops);
+    }
+    free(patterns);
+    free(segments);
+    free(copy);
+    return matches;
+}
+#endif
+
+// Looks name up in the generated perfect-hash table: one hash, one strcmp.
+const BuiltinSlot* find_builtin(const char* name) {
+    const BuiltinSlot* slot = &builtin_table[builtin_hash(name, BUILTIN_HASH_SEED) & (BUILTIN_TABLE_SIZE - 1)];
+    if (slot->name != NULL && strcmp(slot->name, name) == 0) {
+        return slot;
+    }
+    return NULL;
+}
+
+// Iterates over the builtins compiled in, for completion. Start with *slot = 0;
+// returns NULL after the last one.
+const char* next_builtin_name(int* slot) {
+    while (*slot < BUILTIN_TABLE_SIZE) {
+        const char* name = builtin_table[(*slot)++].name;
+        if (name != NULL) {
+            return name;
+        }
+    }
+    return NULL;
+}
+
+// Runs a builtin with its redirections applied to the shell's own fds, which
+// are restored afterwards; builtins never fork.
+int execute_builtin(char** argv, int argc, RedirectionInfo* redir_info) {
+    const BuiltinSlot* builtin = find_builtin(argv[0]);
+    if (builtin == NULL) {
+        return 0; // Not a built-in command
+    }
+    SavedFds saved;
+    if (redirect_in_process(redir_info, &saved) == -1) {
+        last_exit_status = 1;
+        return 1;
+    }
+    builtin_redirections = redir_info;
+    last_exit_status = builtin->fn(argv, argc);
+    builtin_redirections = NULL;
+    restore_redirections(&saved);
+    return 1;
+}
+
+int builtin_exit(char** argv, int argc) {
+    printf("Good Bye :)\n");
+    exit(EXIT_SUCCESS);
+}
+
+int builtin_echo(char** argv, int argc) {
+    if (output_echo(stdout, argv, argc) == -1) {
+        perror("echo: write failed");
+        return 1;
+    }
+    return 0;
+}
+
+// Physical working directory, any length; NULL on failure
+char* physical_cwd() {
+    char* cwd = getcwd(NULL, 0);
+    if (cwd == NULL) {
+        perror("getcwd error");
+    }
+    return cwd;
+}
+
+// True when both paths name the same directory
+int is_same_dir(const char* path, const char* other) {
+    struct stat a, b;
+    return stat(path, &a) == 0 && stat(other, &b) == 0 && a.st_dev == b.st_dev && a.st_ino == b.st_ino;
+}
+
+// Resolves path against the logical directory base by text alone: "." and
+// ".." components are dropped or pop the previous one, symlinks are kept.
+char* canonicalize_logical(const char* base, const char* path) {
+    StringBuffer result = {NULL, 0, 0};
+    buffer_append(&result, "", 0);
+    if (path[0] != '/') {
+        buffer_append(&result, base, strlen(base));
+    }
+    const char* p = path;
+    while (*p != '\0') {
+        size_t len = strcspn(p, "/");
+        if (len == 2 && p[0] == '.' && p[1] == '.') {
+            char* last = strrchr(result.data, '/');
+            result.length = (last != NULL) ? (size_t)(last - result.data) : 0;
+            result.data[result.length] = '\0';
+        } else if (len > 0 && !(len == 1 && p[0] == '.')) {
+            if (result.length == 0 || result.data[result.length - 1] != '/') {
+                buffer_append(&result, "/", 1);
+            }
+            buffer_append(&result, p, len);
+        }
+        p += len;
+        p += (*p == '/');
+    }
+    if (result.length == 0) {
+        buffer_append(&result, "/", 1);
+    }
+    return result.data;
+}
+
+// The logical working directory, which cd keeps up to date so pwd never has
+// to ask the kernel. It starts as $PWD when that names the current directory,
+// else as getcwd().
+const char* logical_pwd() {
+    if (shell_pwd == NULL) {
+        char* pwd = getenv("PWD");
+        if (pwd != NULL && pwd[0] == '/' && is_same_dir(pwd, ".")) {
+            shell_pwd = canonicalize_logical("/", pwd);
+        } else {
+            shell_pwd = physical_cwd();
+        }
+    }
+    return (shell_pwd != NULL) ? shell_pwd : ".";
+}
+
+// Makes path (taken over) the logical working directory
+void set_pwd(char* path) {
+    free(shell_oldpwd);
+    shell_oldpwd = shell_pwd;
+    shell_pwd = path;
+#if SHELL_LEVEL >= SHELL_LEVEL_NANO
+    if (shell_oldpwd != NULL) {
+        env_set("OLDPWD", shell_oldpwd);
+    }
+    env_set("PWD", shell_pwd);
+#endif
+}
+
+// chdir to the logical path of dir; when that fails (a ".." the kernel
+// resolves differently, say) dir itself is tried and the path re-read.
+int change_directory(const char* dir) {
+    char* logical = canonicalize_logical(logical_pwd(), dir);
+    if (chdir(logical) != 0) {
+        free(logical);
+        if (chdir(dir) != 0) {
+            perror("chdir error");
+            return 1;
+        }
+        logical = physical_cwd();
+        if (logical == NULL) {
+            return 1;
+        }
+    }
+    set_pwd(logical);
+    return 0;
+}
+
+// cd's lookup of a relative dir through the CDPATH directories, printing the
+// new directory when one of them was used
+int cd_target(const char* dir) {
+    char* cdpath = getenv("CDPATH");
+    int relative = !(dir[0] == '/' || strcmp(dir, ".") == 0 || strcmp(dir, "..") == 0 ||
+                     strncmp(dir, "./", 2) == 0 || strncmp(dir, "../", 3) == 0);
+    if (cdpath != NULL && relative) {
+        const char* entry = cdpath;
+        while (1) {
+            size_t len = strcspn(entry, ":");
+            StringBuffer candidate = {NULL, 0, 0};
+            buffer_append(&candidate, entry, len);
+            if (len > 0) {
+                buffer_append(&candidate, "/", 1);
+            }
+            buffer_append(&candidate, dir, strlen(dir));
+            struct stat st;
+            if (stat(candidate.data, &st) == 0 && S_ISDIR(st.st_mode)) {
+                int status = change_directory(candidate.data);
+                free(candidate.data);
+                if (status == 0 && len > 0) {
+                    printf("%s\n", shell_pwd);
+                }
+                return status;
+            }
+            free(candidate.data);
+            if (entry[len] == '\0') {
+                break;
+            }
+            entry += len + 1;
+        }
+    }
+    return change_directory(dir);
+}
+
+// pwd [-P]: the logical directory, or with -P the physical one
+int builtin_pwd(char** argv, int argc) {
+    if (argc > 1 && strcmp(argv[1], "-P") == 0) {
+        char* cwd = physical_cwd();
+        if (cwd == NULL) {
+            return 1;
+        }
+        printf("%s\n", cwd);
+        free(cwd);
+        return 0;
+    }
+    printf("%s\n", logical_pwd());
+    return 0;
+}
+
+// cd [DIR | -]: HOME by default, the previous directory for "-"
+int builtin_cd(char** argv, int argc) {
+    if (argc > 2) {
+        fprintf(stderr, "cd: too many arguments\n");
+        return 1;
+    }
+    if (argc == 2 && strcmp(argv[1], "-") == 0) {
+        if (shell_oldpwd == NULL) {
+            fprintf(stderr, "cd: OLDPWD not set\n");
+            return 1;
+        }
+        char* dir = strdup(shell_oldpwd);
+        if (dir == NULL) {
+            perror("strdup failed");
+            exit(EXIT_FAILURE);
+        }
+        int status = change_directory(dir);
+        free(dir);
+        if (status == 0) {
+            printf("%s\n", shell_pwd);
+        }
+        return status;
+    }
+    char* dir = (argc == 1) ? getenv("HOME") : argv[1];
+    if (dir == NULL) {
+        fprintf(stderr, "cd: HOME not set\n");
+        return 1;
+    }
+    return cd_target(dir);
+}
+
+#if SHELL_LEVEL >= SHELL_LEVEL_MICRO
+// Opens a directory for the stack: O_PATH needs no read permission, and
+// fchdir to it later skips resolving the path again
+int open_dir_fd(const char* path) {
+    int fd = open(path, O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1) {
+        perror("open directory failed");
+    }
+    return fd;
+}
+
+void dir_stack_push(int fd, char* path) {
+    if (dir_stack_size == dir_stack_capacity) {
+        dir_stack_capacity = (dir_stack_capacity == 0) ? 8 : dir_stack_capacity * 2;
+        DirStackEntry* new_stack = (DirStackEntry*)realloc(dir_stack, sizeof(DirStackEntry) * dir_stack_capacity);
+        if (new_stack == NULL) {
+            perror("realloc failed");
+            exit(EXIT_FAILURE);
+        }
+        dir_stack = new_stack;
+    }
+    dir_stack[dir_stack_size].fd = fd;
+    dir_stack[dir_stack_size].path = path;
+    dir_stack_size++;
+}
+
+// dirs: the current directory, then the stack from the top
+int builtin_dirs(char** argv, int argc) {
+    printf("%s", logical_pwd());
+    for (int i = dir_stack_size - 1; i >= 0; i--) {
+        printf(" %s", dir_stack[i].path);
+    }
+    printf("\n");
+    return 0;
+}
+
+// pushd DIR saves the current directory and changes to DIR; pushd alone
+// swaps the current directory with the top of the stack
+int builtin_pushd(char** argv, int argc) {
+    if (argc > 2) {
+        fprintf(stderr, "pushd: too many arguments\n");
+        return 1;
+    }
+    if (argc == 1 && dir_stack_size == 0) {
+        fprintf(stderr, "pushd: no other directory\n");
+        return 1;
+    }
+    int fd = open_dir_fd(".");
+    if (fd == -1) {
+        return 1;
+    }
+    char* path = strdup(logical_pwd());
+    if (path == NULL) {
+        perror("strdup failed");
+        exit(EXIT_FAILURE);
+    }
+    if (argc == 1) {
+        DirStackEntry* top = &dir_stack[dir_stack_size - 1];
+        if (fchdir(top->fd) != 0) {
+            perror("fchdir failed");
+            close(fd);
+            free(path);
+            return 1;
+        }
+        close(top->fd);
+        set_pwd(top->path);
+        top->fd = fd;
+        top->path = path;
+    } else {
+        if (cd_target(argv[1]) != 0) {
+            close(fd);
+            free(path);
+            return 1;
+        }
+        dir_stack_push(fd, path);
+    }
+    return builtin_dirs(argv, argc);
+}
+
+// popd: returns to the directory on top of the stack
+int builtin_popd(char** argv, int argc) {
+    if (dir_stack_size == 0) {
+        fprintf(stderr, "popd: directory stack empty\n");
+        return 1;
+    }
+    DirStackEntry* top = &dir_stack[dir_stack_size - 1];
+    logical_pwd();
+    if (fchdir(top->fd) != 0) {
+        perror("fchdir failed");
+        return 1;
+    }
+    close(top->fd);
+    set_pwd(top->path);
+    dir_stack_size--;
+    return builtin_dirs(argv, argc);
+}
+#endif
+
+#if SHELL_LEVEL >= SHELL_LEVEL_NANO
+int builtin_export(char** argv, int argc) {
+    if (argc != 2) {
+        fprintf(stderr, "export: invalid number of arguments\n");
+        return 1;
+    }
+    return export_variable(argv[1]) == -1 ? 1 : 0;
+}
+
+int builtin_unset(char** argv, int argc) {
+    for (int i = 1; i < argc; i++) {
+        remove_shell_var(argv[i]);
+        env_unset(argv[i]);
+    }
+    return 0;
+}
+
+// One writev for the whole environment (or one per OUTPUT_VEC_MAX / 2 entries)
+int builtin_printenv(char** argv, int argc) {
+    OutputVec out;
+    output_init(&out, stdout);
+    for (char** env = environ; *env != 0; env++) {
+        output_add_string(&out, *env);
+        output_add(&out, "\n", 1);
+    }
+    if (output_flush(&out) == -1) {
+        perror("printenv: write failed");
+        return 1;
+    }
+    return 0;
+}
+#endif
+
+// Runs one parsed command line: builtin, in-process utility or external
+// command. When tracing, the command is measured and logged.
+void dispatch_command(char** argv, int argc, RedirectionInfo* redir_info) {
+#if SHELL_LEVEL >= SHELL_LEVEL_MICRO
+    CommandStats stats;
+    CommandStats* outer_stats = active_stats;
+    if (trace_fd != -1) {
+        stats_begin(&stats);
+        active_stats = &stats;
+    }
+    // Limits must not stick to the shell: even builtins run in the child
+    if (active_limits != NULL) {
+        execute_command(argv, argc, redir_info);
+    } else
+#endif
+    if (execute_builtin(argv, argc, redir_info) == 0 && execute_utility(argv, argc, redir_info) == 0) {
+        execute_command(argv, argc, redir_info);
+    }
+#if SHELL_LEVEL >= SHELL_LEVEL_MICRO
+    // Restored even when the command turned tracing off, so active_stats
+    // never outlives stats
+    if (active_stats == &stats) {
+        active_stats = outer_stats;
+        if (trace_fd != -1) {
+            stats_end(&stats);
+            trace_command(&stats, argv, argc);
+        }
+    }
+#endif
+}
+
+void execute_command(char** argv, int argc, RedirectionInfo* redir_info) {
+    // While measuring, the child's exec closes a close-on-exec pipe, which
+    // marks the end of the spawn phase
+    int exec_pipe[2] = {-1, -1};
+    if (active_stats != NULL && pipe2(exec_pipe, O_CLOEXEC) == -1) {
+        exec_pipe[0] = exec_pipe[1] = -1;
+    }
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork failed");
+        last_exit_status = 1;
+        if (exec_pipe[0] != -1) {
+            close(exec_pipe[0]);
+            close(exec_pipe[1]);
+        }
+        return;
+    } else if (pid == 0) {
+        // Child process
+#if SHELL_LEVEL >= SHELL_LEVEL_MICRO
+        if (active_limits != NULL) {
+            if (apply_job_limits(active_limits) == -1) {
+                exit(EXIT_FAILURE);
+            }
+            if (execute_builtin(argv, argc, redir_info) || execute_utility(argv, argc, redir_info)) {
+                fflush(stdout);
+                _exit(last_exit_status);
+            }
+        }
+#endif
+        run_child(argv, redir_info);
+    } else {
+        // Parent process
+        int status;
+        struct rusage usage;
+        if (exec_pipe[0] != -1) {
+            char byte;
+            struct timespec exec_time;
+            close(exec_pipe[1]);
+            while (read(exec_pipe[0], &byte, 1) == -1 && errno == EINTR) {
+            }
+            close(exec_pipe[0]);
+            clock_gettime(CLOCK_MONOTONIC, &exec_time);
+            active_stats->spawn_us = (exec_time.tv_sec - active_stats->start.tv_sec) * 1e6 +
+                                     (exec_time.tv_nsec - active_stats->start.tv_nsec) / 1e3;
+        }
+        if (wait4(pid, &status, 0, &usage) == -1) {
+            perror("waitpid failed");
+            return;
+        }
+        if (active_stats != NULL) {
+            active_stats->pid = pid;
+            active_stats->maxrss_kb = usage.ru_maxrss;
+        }
+        if (WIFEXITED(status)) {
+            last_exit_status = WEXITSTATUS(status);
+            if (WEXITSTATUS(status) != 0) {
+                fprintf(stderr, "command failed\n");
+            }
+        } else if (WIFSIGNALED(status)) {
+            last_exit_status = 128 + WTERMSIG(status);
+        }
+    }
+}
+
+// Points stderr at stdout in a child about to exec, keeping the old stderr in
+// *saved for the failure path
+void redirect_error_to_output(int* saved) {
+    if (*saved == -1) {
+        *saved = dup(2);
+    }
+    if (dup2(1, 2) == -1) {
+        perror("dup2 error failed");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Applies the redirections and replaces the current (child) process with argv.
+// Never returns.
+void run_child(char** argv, RedirectionInfo* redir_info) {
+    int fd_in_dup = -1;
+    int fd_out_dup = -1;
+    int fd_err_dup = -1;
+#if SHELL_LEVEL >= SHELL_LEVEL_MICRO
+    // Handle a here-document or here-string
+    if (redir_info->here_body != NULL) {
+        int fd_here = open_here_document(redir_info->here_body, redir_info->here_length);
+        if (fd_here == -1) {
+            exit(EXIT_FAILURE);
+        }
+        if (dup2(fd_here, 0) == -1) {
+            perror("dup2 input failed");
+            exit(EXIT_FAILURE);
+        }
+        close(fd_here);
+    }
+#endif
+    // Handle input redirection
+    if (redir_info->input_file != NULL) {
+        int fd_in = open(redir_info->input_file, O_RDONLY);
+        if (fd_in == -1) {
+            perror("open input file failed");
+            exit(EXIT_FAILURE);
+        }
+        fd_in_dup = dup(0); // Duplicate stdin
+        if (fd_in_dup == -1) {
+            perror("dup input failed");
+            close(fd_in);
+            exit(EXIT_FAILURE);
+        }
+        if (dup2(fd_in, 0) == -1) {
+            perror("dup2 input failed");
+            close(fd_in);
+            exit(EXIT_FAILURE);
+        }
+        close(fd_in);
+    }
+
+    // Handle error redirection
+    if (redir_info->error_file != NULL) {
+        int fd_err = open(redir_info->error_file, O_WRONLY | O_CREAT | (redir_info->append_error ? O_APPEND : O_TRUNC), 0644);
+        if (fd_err == -1) {
+            perror("open error file failed");
+            exit(EXIT_FAILURE);
+        }
+        fd_err_dup = dup(2); // Duplicate stderr
+        if (fd_err_dup == -1) {
+            perror("dup error failed");
+            close(fd_err);
+            exit(EXIT_FAILURE);
+        }
+        if (dup2(fd_err, 2) == -1) {
+            perror("dup2 error failed");
+            close(fd_err);
+            exit(EXIT_FAILURE);
+        }
+        close(fd_err);
+    }
+
+    // Handle "2>&1" before a ">": stderr takes stdout as it is now
+    if (redir_info->error_to_output == ERROR_TO_OUTPUT_BEFORE) {
+        redirect_error_to_output(&fd_err_dup);
+    }
+
+    // Handle output redirection
+    if (redir_info->output_file != NULL) {
+        int fd_out = open(redir_info->output_file, O_WRONLY | O_CREAT | (redir_info->append_output ? O_APPEND : O_TRUNC), 0644);
+        if (fd_out == -1) {
+            perror("open output file failed");
+            exit(EXIT_FAILURE);
+        }
+        fd_out_dup = dup(1); // Duplicate stdout
+        if (fd_out_dup == -1) {
+            perror("dup output failed");
+            close(fd_out);
+            exit(EXIT_FAILURE);
+        }
+        if (dup2(fd_out, 1) == -1) {
+            perror("dup2 output failed");
+            close(fd_out);
+            exit(EXIT_FAILURE);
+        }
+        close(fd_out);
+    }
+
+    // Handle "2>&1" after a ">": stderr follows wherever stdout now points
+    if (redir_info->error_to_output == ERROR_TO_OUTPUT_AFTER) {
+        redirect_error_to_output(&fd_err_dup);
+    }
+
+    execvp(argv[0], argv);
+
+    // If execvp returns, there was an error
+    perror("execvp failed");
+    
+    // Restore file descriptors if needed
+    if (fd_in_dup != -1) {
+        dup2(fd_in_dup, 0);
+        close(fd_in_dup);
+    }
+    if (fd_out_dup != -1) {
+        dup2(fd_out_dup, 1);
+        close(fd_out_dup);
+    }
+    if (fd_err_dup != -1) {
+        dup2(fd_err_dup, 2);
+        close(fd_err_dup);
+    }
+    exit(EXIT_FAILURE);
+}
+
+#if SHELL_LEVEL >= SHELL_LEVEL_MICRO
+// Parses a CPU list such as "0-3,8" into set
+int parse_cpu_list(const char* list, cpu_set_t* set) {
+    CPU_ZERO(set);
+    const char* p = list;
+    while (*p != '\0') {
+        char* end;
+        long first = strtol(p, &end, 10);
+        long last = first;
+        if (end == p) {
+            return -1;
+        }
+        if (*end == '-') {
+            p = end + 1;
+            last = strtol(p, &end, 10);
+            if (end == p) {
+                return -1;
+            }
+        }
+        if (first < 0 || last < first || last >= CPU_SETSIZE) {
+            return -1;
+        }
+        for (long cpu = first; cpu <= last; cpu++) {
+            CPU_SET(cpu, set);
+        }
+        if (*end == ',') {
+            end++;
+        } else if (*end != '\0') {
+            return -1;
+        }
+        p = end;
+    }
+    return CPU_COUNT(set) > 0 ? 0 : -1;
+}
+
+// Parses a byte count with an optional K, M or G suffix
+int parse_size(const char* text, rlim_t* size) {
+    char* end;
+    unsigned long long value = strtoull(text, &end, 10);
+    if (end == text) {
+        return -1;
+    }
+    switch (*end) {
+    case 'K':
+    case 'k':
+        value <<= 10;
+        end++;
+        break;
+    case 'M':
+    case 'm':
+        value <<= 20;
+        end++;
+        break;
+    case 'G':
+    case 'g':
+        value <<= 30;
+        end++;
+        break;
+    }
+    if (*end != '\0' || value == 0) {
+        return -1;
+    }
+    *size = (rlim_t)value;
+    return 0;
+}
+
+// Parses one @key=value word (without the '@') into limits
+int parse_job_limit(const char* word, JobLimits* limits) {
+    const char* value = strchr(word, '=') + 1;
+    size_t key_len = value - 1 - word;
+    char* end;
+    if (key_len == 4 && strncmp(word, "cpus", 4) == 0) {
+        limits->has_cpus = 1;
+        return parse_cpu_list(value, &limits->cpus);
+    } else if (key_len == 4 && strncmp(word, "nice", 4) == 0) {
+        limits->has_nice = 1;
+        limits->nice = (int)strtol(value, &end, 10);
+        return (end != value && *end == '\0' && limits->nice >= -20 && limits->nice <= 19) ? 0 : -1;
+    } else if (key_len == 5 && strncmp(word, "sched", 5) == 0) {
+        limits->has_sched = 1;
+        if (strcmp(value, "other") == 0) {
+            limits->sched_policy = SCHED_OTHER;
+        } else if (strcmp(value, "batch") == 0) {
+            limits->sched_policy = SCHED_BATCH;
+        } else if (strcmp(value, "idle") == 0) {
+            limits->sched_policy = SCHED_IDLE;
+        } else {
+            return -1;
+        }
+        return 0;
+    } else if (key_len == 3 && strncmp(word, "mem", 3) == 0) {
+        return parse_size(value, &limits->mem);
+    } else if (key_len == 3 && strncmp(word, "fds", 3) == 0) {
+        return parse_size(value, &limits->fds);
+    } else if (key_len == 6 && strncmp(word, "cgroup", 6) == 0) {
+        // Relative paths are taken from the cgroup v2 mount point
+        int len = snprintf(limits->cgroup, sizeof(limits->cgroup), "%s%s",
+                           value[0] == '/' ? "" : "/sys/fs/cgroup/", value);
+        return (value[0] != '\0' && len < (int)sizeof(limits->cgroup)) ? 0 : -1;
+    }
+    return -1;
+}
+
+// Removes the leading @key=value words of argv (they may be mixed with
+// NAME=value assignments) and collects them into limits. Returns -1 after
+// reporting an invalid one.
+int take_job_limits(char** argv, int* argc, JobLimits* limits) {
+    memset(limits, 0, sizeof(*limits));
+    int status = 0;
+    int kept = 0;
+    int i;
+    for (i = 0; i < *argc; i++) {
+        if (argv[i][0] == '@' && strchr(argv[i], '=') != NULL) {
+            if (parse_job_limit(argv[i] + 1, limits) == -1) {
+                fprintf(stderr, "invalid job limit: %s\n", argv[i]);
+                status = -1;
+            }
+            limits->active = 1;
+            free(argv[i]);
+        } else if (is_assignment_word(argv[i])) {
+            argv[kept++] = argv[i];
+        } else {
+            break;
+        }
+    }
+    // Moves the rest down, with the terminating NULL
+    memmove(argv + kept, argv + i, sizeof(char*) * (*argc - i + 1));
+    *argc -= i - kept;
+    return status;
+}
+
+// Applies limits to the calling process: the child, before it execs
+int apply_job_limits(const JobLimits* limits) {
+    if (limits->cgroup[0] != '\0') {
+        char procs[sizeof(limits->cgroup) + 16];
+        snprintf(procs, sizeof(procs), "%s/cgroup.procs", limits->cgroup);
+        int fd = open(procs, O_WRONLY | O_CLOEXEC);
+        if (fd == -1) {
+            perror("cgroup placement failed");
+            return -1;
+        }
+        char pid_text[16];
+        int len = snprintf(pid_text, sizeof(pid_text), "%d\n", (int)getpid());
+        if (write(fd, pid_text, len) != len) {
+            perror("cgroup placement failed");
+            close(fd);
+            return -1;
+        }
+        close(fd);
+    }
+    if (limits->has_cpus && sched_setaffinity(0, sizeof(cpu_set_t), &limits->cpus) == -1) {
+        perror("sched_setaffinity failed");
+        return -1;
+    }
+    if (limits->has_sched) {
+        struct sched_param param = {0};
+        if (sched_setscheduler(0, limits->sched_policy, &param) == -1) {
+            perror("sched_setscheduler failed");
+            return -1;
+        }
+    }
+    if (limits->has_nice && setpriority(PRIO_PROCESS, 0, limits->nice) == -1) {
+        perror("setpriority failed");
+        return -1;
+    }
+    if (limits->mem != 0) {
+        struct rlimit limit = {limits->mem, limits->mem};
+        if (setrlimit(RLIMIT_AS, &limit) == -1) {
+            perror("setrlimit memory failed");
+            return -1;
+        }
+    }
+    if (limits->fds != 0) {
+        struct rlimit limit = {limits->fds, limits->fds};
+        if (setrlimit(RLIMIT_NOFILE, &limit) == -1) {
+            perror("setrlimit fds failed");
+            return -1;
+        }
+    }
+    return 0;
+}
+#endif
+
+#if SHELL_LEVEL >= SHELL_LEVEL_MICRO
+// Records the word after "<<<" (mode 4: the here-string itself) or after "<<"
+// (mode 5: the delimiter of a body still to be read). Either one replaces an
+// earlier "<" file.
+void set_here_word(const char* word, int mode, RedirectionInfo* redir_info) {
+    free(redir_info->input_file);
+    redir_info->input_file = NULL;
+    free(redir_info->here_body);
+    redir_info->here_body = NULL;
+    if (mode == 4) {
+        size_t length = strlen(word);
+        redir_info->here_body = (char*)malloc(length + 2);
+        if (redir_info->here_body == NULL) {
+            perror("malloc failed");
+            exit(EXIT_FAILURE);
+        }
+        memcpy(redir_info->here_body, word, length);
+        memcpy(redir_info->here_body + length, "\n", 2);
+        redir_info->here_length = length + 1;
+    } else {
+        free(redir_info->here_delimiter);
+        redir_info->here_delimiter = strdup(word);
+        if (redir_info->here_delimiter == NULL) {
+            perror("malloc failed");
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+ssize_t read_stdin_line(char** line, size_t* capacity) {
+    ssize_t length = getline(line, capacity, stdin);
+    if (length > 0 && (*line)[length - 1] == '\n') {
+        (*line)[--length] = '\0';
+    }
+    return length;
+}
+
+// Reads the body of a "<<WORD" here-document, up to a line that is just WORD.
+// $NAME, $(...) and `...` in the body are expanded unless WORD was quoted.
+void read_here_document(RedirectionInfo* redir_info) {
+    char* delimiter = redir_info->here_delimiter;
+    size_t delimiter_len = strlen(delimiter);
+    int expand = 1;
+    if (delimiter_len >= 2 && (delimiter[0] == '\'' || delimiter[0] == '"') &&
+        delimiter[delimiter_len - 1] == delimiter[0]) {
+        delimiter[delimiter_len - 1] = '\0';
+        delimiter++;
+        expand = 0;
+    }
+    StringBuffer body = {(char*)malloc(MAX_INPUT), 0, MAX_INPUT};
+    if (body.data == NULL) {
+        perror("malloc failed");
+        exit(EXIT_FAILURE);
+    }
+    body.data[0] = '\0';
+    char* line = NULL;
+    size_t line_capacity = 0;
+    while (1) {
+        if (read_continuation_line(&line, &line_capacity) == -1) {
+            fprintf(stderr, "here-document ended by end of input (wanted '%s')\n", delimiter);
+            break;
+        }
+        char* text = line;
+        if (redir_info->here_strip_tabs) {
+            text += strspn(text, "\t");
+        }
+        if (strcmp(text, delimiter) == 0) {
+            break;
+        }
+        if (expand) {
+            expand_variables(text, &body);
+        } else {
+            buffer_append(&body, text, strlen(text));
+        }
+        buffer_append(&body, "\n", 1);
+    }
+    free(line);
+    free(redir_info->here_delimiter);
+    redir_info->here_delimiter = NULL;
+    if (redir_info->input_file != NULL) {
+        // A later "<" won; the body was only consumed
+        free(body.data);
+        return;
+    }
+    redir_info->here_body = body.data;
+    redir_info->here_length = body.length;
+}
+
+// Returns a close-on-exec fd reading the body, which never touches the
+// filesystem. A body that fits in one atomic pipe write goes through a pipe;
+// a larger one, which could fill the pipe before the command reads it, goes
+// into a memfd sealed against any further change.
+int open_here_document(const char* body, size_t length) {
+    if (length <= PIPE_BUF) {
+        int fds[2];
+        if (pipe2(fds, O_CLOEXEC) == -1) {
+            perror("pipe failed");
+            return -1;
+        }
+        if (write_full(fds[1], body, length) == -1) {
+            perror("write here-document failed");
+            close(fds[0]);
+            close(fds[1]);
+            return -1;
+        }
+        close(fds[1]);
+        return fds[0];
+    }
+    int fd = memfd_create("here-document", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd == -1) {
+        perror("memfd_create failed");
+        return -1;
+    }
+    if (write_full(fd, body, length) == -1 ||
+        fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) == -1 ||
+        lseek(fd, 0, SEEK_SET) == -1) {
+        perror("here-document failed");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+#endif
+
+// Points fd at the open file_fd (which is closed) for an in-process command,
+// keeping a close-on-exec copy of the shell's original fd in *saved.
+int replace_fd_in_process(int fd, int file_fd, int* saved) {
+    if (file_fd == -1) {
+        return -1;
+    }
+    *saved = fcntl(fd, F_DUPFD_CLOEXEC, 10);
+    if (*saved == -1 || dup2(file_fd, fd) == -1) {
+        perror("dup2 redirection failed");
+        close(file_fd);
+        return -1;
+    }
+    close(file_fd);
+    return 0;
+}
+
+// Points fd at path for an in-process command, as replace_fd_in_process
+int redirect_fd_in_process(int fd, const char* path, int flags, int* saved) {
+    int file_fd = open(path, flags | O_CLOEXEC, 0644);
+    if (file_fd == -1) {
+        perror("open redirection file failed");
+        return -1;
+    }
+    return replace_fd_in_process(fd, file_fd, saved);
+}
+
+// Points the shell's stderr at its stdout for an in-process "2>&1"
+int error_to_output_in_process(SavedFds* saved) {
+    if (saved->saved[2] == -1) {
+        saved->saved[2] = fcntl(2, F_DUPFD_CLOEXEC, 10);
+    }
+    if (saved->saved[2] == -1 || dup2(1, 2) == -1) {
+        perror("dup2 redirection failed");
+        return -1;
+    }
+    return 0;
+}
+
+// Applies redir_info to the shell's own fds 0-2 without forking, in the order
+// the words came in.
+// On failure the fds already redirected are restored and -1 is returned.
+int redirect_in_process(RedirectionInfo* redir_info, SavedFds* saved) {
+    saved->saved[0] = saved->saved[1] = saved->saved[2] = -1;
+    fflush(stdout);
+    fflush(stderr);
+    int output_flags = O_WRONLY | O_CREAT | (redir_info->append_output ? O_APPEND : O_TRUNC);
+    int error_flags = O_WRONLY | O_CREAT | (redir_info->append_error ? O_APPEND : O_TRUNC);
+    if ((redir_info->input_file != NULL &&
+         redirect_fd_in_process(0, redir_info->input_file, O_RDONLY, &saved->saved[0]) == -1) ||
+#if SHELL_LEVEL >= SHELL_LEVEL_MICRO
+        (redir_info->here_body != NULL &&
+         replace_fd_in_process(0, open_here_document(redir_info->here_body, redir_info->here_length),
+                               &saved->saved[0]) == -1) ||
+#endif
+        (redir_info->error_file != NULL &&
+         redirect_fd_in_process(2, redir_info->error_file, error_flags, &saved->saved[2]) == -1) ||
+        (redir_info->error_to_output == ERROR_TO_OUTPUT_BEFORE && error_to_output_in_process(saved) == -1) ||
+        (redir_info->output_file != NULL &&
+         redirect_fd_in_process(1, redir_info->output_file, output_flags, &saved->saved[1]) == -1) ||
+        (redir_info->error_to_output == ERROR_TO_OUTPUT_AFTER && error_to_output_in_process(saved) == -1)) {
+        restore_redirections(saved);
+        return -1;
+    }
+    stdin_redirected = (saved->saved[0] != -1);
+    return 0;
+}
+
+// Flushes what the in-process command wrote and puts the shell's fds back.
+void restore_redirections(SavedFds* saved) {
+    fflush(stdout);
+    fflush(stderr);
+    for (int fd = 0; fd < 3; fd++) {
+        if (saved->saved[fd] != -1) {
+            dup2(saved->saved[fd], fd);
+            close(saved->saved[fd]);
+            saved->saved[fd] = -1;
+        }
+    }
+    stdin_redirected = 0;
+}
+
+// Runs my_cp, my_mv, my_echo and my_pwd in-process when the shell is built
+// with -DWITH_MY_UTILS. Returns 0 when argv[0] is not one of them.
+int execute_utility(char** argv, int argc, RedirectionInfo* redir_info) {
+#ifdef WITH_MY_UTILS
+    const MyUtility* utility = find_my_utility(argv[0]);
+    if (utility == NULL) {
+        return 0;
+    }
+    SavedFds saved;
+    if (redirect_in_process(redir_info, &saved) == -1) {
+        last_exit_status = 1;
+        return 1;
+    }
+    last_exit_status = utility->main(argc, argv);
+    restore_redirections(&saved);
+    if (last_exit_status != 0) {
+        fprintf(stderr, "command failed\n");
+    }
+    return 1;
+#else
+    (void)argv;
+    (void)argc;
+    (void)redir_info;
+    return 0;
+#endif
+}
+
+#if SHELL_LEVEL >= SHELL_LEVEL_MICRO
+double timeval_us(struct timeval tv) {
+    return tv.tv_sec * 1e6 + tv.tv_usec;
+}
+
+void stats_begin(CommandStats* stats) {
+    memset(stats, 0, sizeof(*stats));
+    getrusage(RUSAGE_SELF, &stats->self_start);
+    getrusage(RUSAGE_CHILDREN, &stats->children_start);
+    clock_gettime(CLOCK_MONOTONIC, &stats->start);
+}
+
+// CPU time is the shell's own usage plus that of every child reaped while the
+// command ran, so in-process commands that spawn (parallel) are covered too.
+void stats_end(CommandStats* stats) {
+    struct timespec end;
+    struct rusage self_end, children_end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    getrusage(RUSAGE_SELF, &self_end);
+    getrusage(RUSAGE_CHILDREN, &children_end);
+    stats->wall_us = (end.tv_sec - stats->start.tv_sec) * 1e6 + (end.tv_nsec - stats->start.tv_nsec) / 1e3;
+    stats->user_us = timeval_us(self_end.ru_utime) - timeval_us(stats->self_start.ru_utime) +
+                     timeval_us(children_end.ru_utime) - timeval_us(stats->children_start.ru_utime);
+    stats->sys_us = timeval_us(self_end.ru_stime) - timeval_us(stats->self_start.ru_stime) +
+                    timeval_us(children_end.ru_stime) - timeval_us(stats->children_start.ru_stime);
+    if (stats->pid == 0) {
+        stats->maxrss_kb = self_end.ru_maxrss;
+    }
+}
+
+// Appends one JSON line describing the command to the trace. The line goes
+// out in a single write, so shells sharing an O_APPEND file do not interleave.
+void trace_command(CommandStats* stats, char** argv, int argc) {
+    char* line = NULL;
+    size_t length = 0;
+    FILE* out = open_memstream(&line, &length);
+    if (out == NULL) {
+        return;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    fprintf(out, "{\"ts\":%ld.%06ld,\"shell_pid\":%d,\"argv\":[", (long)now.tv_sec, now.tv_nsec / 1000, (int)getpid());
+    for (int i = 0; i < argc; i++) {
+        fputs(i == 0 ? "\"" : ",\"", out);
+        for (const unsigned char* p = (const unsigned char*)argv[i]; *p != '\0'; p++) {
+            if (*p == '"' || *p == '\\') {
+                fprintf(out, "\\%c", *p);
+            } else if (*p < 0x20) {
+                fprintf(out, "\\u%04x", *p);
+            } else {
+                fputc(*p, out);
+            }
+        }
+        fputc('"', out);
+    }
+    fprintf(out, "],\"in_process\":%s,\"status\":%d,\"spawn_us\":%.1f,\"wall_us\":%.1f,"
+                 "\"user_us\":%.0f,\"sys_us\":%.0f,\"maxrss_kb\":%ld}\n",
+            stats->pid == 0 ? "true" : "false", last_exit_status, stats->spawn_us, stats->wall_us,
+            stats->user_us, stats->sys_us, stats->maxrss_kb);
+    fclose(out);
+    if (write_full(trace_fd, line, length) == -1) {
+        perror("trace: write failed");
+    }
+    free(line);
+}
+
+// time cmd [args...]
+// Runs the command and reports wall, CPU, max RSS and spawn latency on stderr.
+int builtin_time(char** argv, int argc) {
+    if (argc < 2) {
+        fprintf(stderr, "time: usage: time command [args]\n");
+        return 1;
+    }
+    CommandStats stats;
+    CommandStats* outer_stats = active_stats;
+    RedirectionInfo no_redir = {0};
+    stats_begin(&stats);
+    active_stats = &stats;
+    if (execute_builtin(argv + 1, argc - 1, &no_redir) == 0 && execute_utility(argv + 1, argc - 1, &no_redir) == 0) {
+        execute_command(argv + 1, argc - 1, &no_redir);
+    }
+    active_stats = outer_stats;
+    stats_end(&stats);
+    fprintf(stderr, "real %.3fs  user %.3fs  sys %.3fs  maxrss %ldKB", stats.wall_us / 1e6, stats.user_us / 1e6,
+            stats.sys_us / 1e6, stats.maxrss_kb);
+    if (stats.pid != 0) {
+        fprintf(stderr, "  spawn %.1fus", stats.spawn_us);
+    }
+    fprintf(stderr, "\n");
+    return last_exit_status;
+}
+
+// trace FILE | trace -fd N | trace off
+// Logs every command as a JSON line; MICRO_SHELL_TRACE=FILE enables it at startup.
+int builtin_trace(char** argv, int argc) {
+    int fd;
+    if (argc == 2 && strcmp(argv[1], "off") == 0) {
+        fd = -1;
+    } else if (argc == 3 && strcmp(argv[1], "-fd") == 0) {
+        fd = fcntl(atoi(argv[2]), F_DUPFD_CLOEXEC, 10);
+        if (fd == -1) {
+            perror("trace: invalid fd");
+            return 1;
+        }
+    } else if (argc == 2) {
+        fd = open(argv[1], O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (fd == -1) {
+            perror("trace: open failed");
+            return 1;
+        }
+    } else {
+        fprintf(stderr, "trace: usage: trace FILE | trace -fd N | trace off\n");
+        return 1;
+    }
+    if (trace_fd != -1) {
+        close(trace_fd);
+    }
+    trace_fd = fd;
+    return 0;
+}
+#endif
+
+// Writes all of buf, retrying on short writes and EINTR.
+int write_full(int fd, const void* buf, size_t len) {
+    const char* p = (const char*)buf;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// Reads exactly len bytes; fails on EOF.
+int read_full(int fd, void* buf, size_t len) {
+    char* p = (char*)buf;
+    while (len > 0) {
+        ssize_t n = read(fd, p, len);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (n == 0) {
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+void free_arguments(char** argv, int argc) {
+    for (int i = 0; i < argc; i++) {
+        free(argv[i]);
+    }
+    free(argv);
+}
+
+// Appends len bytes of text to buffer, growing it as needed; the contents stay
+// NUL-terminated.
+void buffer_append(StringBuffer* buffer, const char* text, size_t len) {
+    if (buffer->length + len + 1 > buffer->capacity) {
+        size_t capacity = buffer->capacity * 2;
+        if (capacity < buffer->length + len + 1) {
+            capacity = buffer->length + len + 1;
+        }
+        char* new_data = (char*)realloc(buffer->data, capacity);
+        if (new_data == NULL) {
+            perror("realloc failed");
+            exit(EXIT_FAILURE);
+        }
+        buffer->data = new_data;
+        buffer->capacity = capacity;
+    }
+    memcpy(buffer->data + buffer->length, text, len);
+    buffer->length += len;
+    buffer->data[buffer->length] = '\0';
+}
+
+#if SHELL_LEVEL >= SHELL_LEVEL_NANO
+// Sets name to value. An existing variable is updated in place, reusing the
+// old value's storage when the new value fits, so reassigning the same name
+// over and over neither grows the array nor allocates.
+void add_shell_var(const char* name, const char* value) {
+    for (int i = 0; i < numShellVars; i++) {
+        if (strcmp(shellVars[i].name, name) == 0) {
+            size_t length = strlen(value);
+            if (length > strlen(shellVars[i].value)) {
+                char* new_value = (char*)realloc(shellVars[i].value, length + 1);
+                if (new_value == NULL) {
+                    perror("realloc failed");
+                    exit(EXIT_FAILURE);
+                }
+                shellVars[i].value = new_value;
+            }
+            memmove(shellVars[i].value, value, length + 1);
+            return;
+        }
+    }
+
+    // Resize the array if needed
+    if (numShellVars == maxShellVars) {
+        maxShellVars = (maxShellVars == 0) ? 1 : maxShellVars * 2;
+        ShellVar* newShellVars = (ShellVar*)realloc(shellVars, sizeof(ShellVar) * maxShellVars);
+        if (newShellVars == NULL) {
+            perror("realloc failed");
+            exit(EXIT_FAILURE);
+        }
+        shellVars = newShellVars;
+    }
+
+    // Allocate memory for the name and value
+    shellVars[numShellVars].name = strdup(name);
+    shellVars[numShellVars].value = strdup(value);
+    if (shellVars[numShellVars].name == NULL || shellVars[numShellVars].value == NULL) {
+        perror("strdup failed");
+        exit(EXIT_FAILURE);
+    }
+
+    numShellVars++;
+}
+
+char* get_shell_var(const char* name) {
+    if (strcmp(name, "?") == 0) {
+        static char status_text[16];
+        snprintf(status_text, sizeof(status_text), "%d", last_exit_status);
+        return status_text;
+    }
+    for (int i = 0; i < numShellVars; i++) {
+        if (strcmp(shellVars[i].name, name) == 0) {
+            return shellVars[i].value;
+        }
+    }
+    return NULL;
+}
+
+void free_shell_vars() {
+    for (int i = 0; i < numShellVars; i++) {
+        free(shellVars[i].name);
+        free(shellVars[i].value);
+    }
+    free(shellVars);
+    shellVars = NULL;
+    numShellVars = maxShellVars = 0;
+    free(line_buffer.data);
+    line_buffer.data = NULL;
+    line_buffer.length = line_buffer.capacity = 0;
+}
+
+// Appends input to out with every $NAME replaced by its value and, in the
+// micro shell, every $(command) or `command` by the command's output. The
+// name is terminated in place for the lookup, so no copy of it is needed.
+void expand_variables(char* input, StringBuffer* out) {
+    char* p = input;
+    while (*p != '\0') {
+#if SHELL_LEVEL >= SHELL_LEVEL_MICRO
+        if (!parse_only && ((p[0] == '$' && p[1] == '(') || p[0] == '`')) {
+            char* body = (p[0] == '$') ? p + 2 : p + 1;
+            char* end = (p[0] == '$') ? find_closing_paren(body) : strchr(body, '`');
+            if (end != NULL) {
+                char saved = *end;
+                *end = '\0';
+                capture_command(body, out);
+                *end = saved;
+                p = end + 1;
+                continue;
+            }
+            // Unterminated: kept literally
+        }
+#endif
+        if (*p != '$') {
+            // Copy up to the next expansion in one go
+            size_t span = strcspn(p + 1, "$`") + 1;
+            buffer_append(out, p, span);
+            p += span;
+            continue;
+        }
+        // A name is letters, digits and '_', or the single character '?'
+        char* name = ++p;
+        if (*p == '?') {
+            p++;
+        } else {
+            while (isalnum((unsigned char)*p) || *p == '_') {
+                p++;
+            }
+        }
+        if (p == name) {
+            // A lone '$' is kept literally
+            buffer_append(out, "$", 1);
+            continue;
+        }
+        char saved = *p;
+        *p = '\0';
+        char* var_value = get_shell_var(name);
+        *p = saved;
+        if (var_value != NULL) {
+            buffer_append(out, var_value, strlen(var_value));
+        }
+    }
+}
+
+// A command substitution's output length is only known once it ran, and it
+// must run only once, so the result grows as it is written.
+char* substitute_variables(char* input) {
+    size_t length = strlen(input);
+    StringBuffer result = {(char*)malloc(length + 1), 0, length + 1};
+    if (result.data == NULL) {
+        perror("malloc failed");
+        exit(EXIT_FAILURE);
+    }
+    result.data[0] = '\0';
+    expand_variables(input, &result);
+    return result.data;
+}
+
+// substitute_variables for a whole input line, into line_buffer instead of a
+// new allocation; the result is valid until the next line
+char* substitute_line(char* input) {
+    if (line_buffer.capacity > LINE_BUFFER_KEEP) {
+        free(line_buffer.data);
+        line_buffer.data = NULL;
+    }
+    if (line_buffer.data == NULL) {
+        line_buffer.data = (char*)malloc(MAX_INPUT);
+        if (line_buffer.data == NULL) {
+            perror("malloc failed");
+            exit(EXIT_FAILURE);
+        }
+        line_buffer.capacity = MAX_INPUT;
+    }
+    line_buffer.length = 0;
+    line_buffer.data[0] = '\0';
+    expand_variables(input, &line_buffer);
+    return line_buffer.data;
+}
+
+#endif
+
+#if SHELL_LEVEL >= SHELL_LEVEL_MICRO
+// The ')' closing a $( whose body starts at body, or NULL when unterminated
+char* find_closing_paren(char* body) {
+    int depth = 1;
+    for (char* p = body; *p != '\0'; p++) {
+        if (*p == '(') {
+            depth++;
+        } else if (*p == ')' && --depth == 0) {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+// Runs command and writes its output to out with trailing newlines removed,
+// as POSIX command substitution does. Builtins that only print run in-process
+// into a memory buffer; anything else runs in a child read through a pipe.
+void capture_command(char* command, StringBuffer* out) {
+    char* substituted_input = substitute_variables(command);
+    int argc;
+    RedirectionInfo redir_info = {0};
+    char** argv = parse_input(substituted_input, &argc, &redir_info);
+    free(substituted_input);
+    if (redir_info.here_delimiter != NULL && redir_info.input_file == NULL) {
+        // No body lines can follow inside $(...): the here-document is empty
+        redir_info.here_body = strdup("");
+        if (redir_info.here_body == NULL) {
+            perror("malloc failed");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    char* output = NULL;
+    size_t length = 0;
+    if (argc > 0) {
+        const BuiltinSlot* builtin = find_builtin(argv[0]);
+        int redirected = (redir_info.input_file != NULL || redir_info.here_body != NULL ||
+                          redir_info.output_file != NULL || redir_info.error_file != NULL ||
+                          redir_info.error_to_output);
+        if (builtin != NULL && (builtin->flags & BUILTIN_PURE) && !redirected) {
+            output = capture_builtin(builtin, argv, argc, &length);
+        } else {
+            output = capture_child(argv, argc, &redir_info, &length);
+        }
+    }
+    while (length > 0 && output[length - 1] == '\n') {
+        length--;
+    }
+    buffer_append(out, output, length);
+    free(output);
+    free_arguments(argv, argc);
+    free_redirection_info(&redir_info);
+}
+
+// Runs a BUILTIN_PURE builtin with stdout pointed at a memory stream: no fork,
+// no pipe.
+char* capture_builtin(const BuiltinSlot* builtin, char** argv, int argc, size_t* length) {
+    char* output = NULL;
+    FILE* capture = open_memstream(&output, length);
+    if (capture == NULL) {
+        perror("open_memstream failed");
+        exit(EXIT_FAILURE);
+    }
+    FILE* saved_stdout = stdout;
+    fflush(stdout);
+    stdout = capture;
+    last_exit_status = builtin->fn(argv, argc);
+    stdout = saved_stdout;
+    if (fclose(capture) != 0) {
+        perror("fclose failed");
+        exit(EXIT_FAILURE);
+    }
+    return output;
+}
+
+// Runs the command in a child with stdout on a pipe and collects what it
+// writes. The child is a subshell: builtins there cannot change the shell.
+char* capture_child(char** argv, int argc, RedirectionInfo* redir_info, size_t* length) {
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) == -1) {
+        perror("pipe failed");
+        last_exit_status = 1;
+        return NULL;
+    }
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork failed");
+        last_exit_status = 1;
+        close(fds[0]);
+        close(fds[1]);
+        return NULL;
+    } else if (pid == 0) {
+        // dup2 clears close-on-exec on the new fd 1
+        if (dup2(fds[1], 1) == -1) {
+            perror("dup2 failed");
+            _exit(EXIT_FAILURE);
+        }
+        if (execute_builtin(argv, argc, redir_info) == 0 && execute_utility(argv, argc, redir_info) == 0) {
+            run_child(argv, redir_info);
+        }
+        fflush(stdout);
+        _exit(last_exit_status);
+    }
+
+    close(fds[1]);
+    char* output = NULL;
+    size_t capacity = 0;
+    *length = 0;
+    while (1) {
+        if (*length == capacity) {
+            capacity = (capacity == 0) ? 4096 : capacity * 2;
+            char* new_output = (char*)realloc(output, capacity);
+            if (new_output == NULL) {
+                perror("realloc failed");
+                exit(EXIT_FAILURE);
+            }
+            output = new_output;
+        }
+        ssize_t n = read(fds[0], output + *length, capacity - *length);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("read failed");
+            break;
+        }
+        if (n == 0) {
+            break;
+        }
+        *length += n;
+    }
+    close(fds[0]);
+
+    int status;
+    if (waitpid(pid, &status, 0) == -1) {
+        perror("waitpid failed");
+    } else if (WIFEXITED(status)) {
+        last_exit_status = WEXITSTATUS(status);
+    } else if (WIFSIGNALED(status)) {
+        last_exit_status = 128 + WTERMSIG(status);
+    }
+    return output;
+}
+#endif
+
+#if SHELL_LEVEL >= SHELL_LEVEL_NANO
+// A line of the form NAME=value. The value is one word: whitespace outside a
+// $(...) or `...` would make the line `NAME=value cmd`.
+int is_valid_assignment(const char* input) {
+    if (!is_assignment_word(input)) {
+        return 0;
+    }
+    int depth = 0;
+    int in_backticks = 0;
+    for (const char* p = strchr(input, '=') + 1; *p != '\0'; p++) {
+        if (p[0] == '$' && p[1] == '(') {
+            depth++;
+            p++;
+        } else if (*p == ')' && depth > 0) {
+            depth--;
+        } else if (*p == '`') {
+            in_backticks = !in_backticks;
+        } else if ((*p == ' ' || *p == '\t') && depth == 0 && !in_backticks) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Copies a shell variable into the environment; -1 when there is none
+int export_variable(const char* name) {
+    char* value = get_shell_var(name);
+    if (value == NULL) {
+        fprintf(stderr, "export: variable not found\n");
+        return -1;
+    }
+    env_set(name, value);
+    return 0;
+}
+
+// Removes name from the shell variables
+void remove_shell_var(const char* name) {
+    int kept = 0;
+    for (int i = 0; i < numShellVars; i++) {
+        if (strcmp(shellVars[i].name, name) == 0) {
+            free(shellVars[i].name);
+            free(shellVars[i].value);
+        } else {
+            shellVars[kept++] = shellVars[i];
+        }
+    }
+    numShellVars = kept;
+}
+
+// True for a NAME=value word, NAME being a letter or '_' followed by letters,
+// digits and '_'
+int is_assignment_word(const char* word) {
+    if (!(isalpha((unsigned char)word[0]) || word[0] == '_')) {
+        return 0;
+    }
+    const char* p = word + 1;
+    while (isalnum((unsigned char)*p) || *p == '_') {
+        p++;
+    }
+    return *p == '=';
+}
+
+// Index of the NAME=value entry of envp for name[0, name_len), or -1
+int env_find(char** envp, int count, const char* name, size_t name_len) {
+    for (int i = 0; i < count; i++) {
+        if (strncmp(envp[i], name, name_len) == 0 && envp[i][name_len] == '=') {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Number of entries in the shell's environment
+int env_count() {
+    if (shell_envp != NULL) {
+        return num_env;
+    }
+    int count = 0;
+    while (environ[count] != NULL) {
+        count++;
+    }
+    return count;
+}
+
+// Takes the environment over on its first change: from then on the shell owns
+// the vector and its strings, and environ points at it.
+void env_own() {
+    if (shell_envp != NULL) {
+        return;
+    }
+    num_env = env_count();
+    max_env = num_env + 16;
+    shell_envp = (char**)malloc(sizeof(char*) * (max_env + 1));
+    if (shell_envp == NULL) {
+        perror("malloc failed");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < num_env; i++) {
+        shell_envp[i] = strdup(environ[i]);
+        if (shell_envp[i] == NULL) {
+            perror("strdup failed");
+            exit(EXIT_FAILURE);
+        }
+    }
+    shell_envp[num_env] = NULL;
+    environ = shell_envp;
+}
+
+// Sets name=value in the shell's environment, replacing or appending one entry
+void env_set(const char* name, const char* value) {
+    env_own();
+    size_t name_len = strlen(name);
+    char* entry = (char*)malloc(name_len + strlen(value) + 2);
+    if (entry == NULL) {
+        perror("malloc failed");
+        exit(EXIT_FAILURE);
+    }
+    sprintf(entry, "%s=%s", name, value);
+
+    int i = env_find(shell_envp, num_env, name, name_len);
+    if (i != -1) {
+        free(shell_envp[i]);
+        shell_envp[i] = entry;
+        return;
+    }
+    if (num_env == max_env) {
+        max_env *= 2;
+        char** new_envp = (char**)realloc(shell_envp, sizeof(char*) * (max_env + 1));
+        if (new_envp == NULL) {
+            perror("realloc failed");
+            exit(EXIT_FAILURE);
+        }
+        shell_envp = new_envp;
+        environ = shell_envp;
+    }
+    shell_envp[num_env++] = entry;
+    shell_envp[num_env] = NULL;
+}
+
+// Removes name from the shell's environment, keeping the order of the rest
+void env_unset(const char* name) {
+    if (shell_envp == NULL && env_find(environ, env_count(), name, strlen(name)) == -1) {
+        return;
+    }
+    env_own();
+    int i = env_find(shell_envp, num_env, name, strlen(name));
+    if (i == -1) {
+        return;
+    }
+    free(shell_envp[i]);
+    memmove(shell_envp + i, shell_envp + i + 1, sizeof(char*) * (num_env - i));
+    num_env--;
+}
+
+// Environment for one command run as `NAME=value ... cmd`: a copy of the
+// environ pointer vector with the assignments replacing or added to its
+// entries. The strings are shared, not copied; free only the vector.
+char** env_overlay(char** assignments, int num_assignments) {
+    int count = env_count();
+    char** envp = (char**)malloc(sizeof(char*) * (count + num_assignments + 1));
+    if (envp == NULL) {
+        perror("malloc failed");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(envp, environ, sizeof(char*) * count);
+    for (int i = 0; i < num_assignments; i++) {
+        size_t name_len = strchr(assignments[i], '=') - assignments[i];
+        int j = env_find(envp, count, assignments[i], name_len);
+        if (j != -1) {
+            envp[j] = assignments[i];
+        } else {
+            envp[count++] = assignments[i];
+        }
+    }
+    envp[count] = NULL;
+    return envp;
+}
+#endif
+
+void free_redirection_info(RedirectionInfo* redir_info) {
+    if (redir_info->input_file != NULL) {
+        free(redir_info->input_file);
+    }
+    if (redir_info->output_file != NULL) {
+        free(redir_info->output_file);
+    }
+    if (redir_info->error_file != NULL) {
+        free(redir_info->error_file);
+    }
+    free(redir_info->here_delimiter);
+    free(redir_info->here_body);
+}
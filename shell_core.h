@@ -0,0 +1,234 @@
+#ifndef SHELL_CORE_H
+#define SHELL_CORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/resource.h>
+#include <time.h>
+
+// Feature levels. Each shell compiles shell_core.c with -DSHELL_LEVEL=<level>:
+// pico runs builtins and external commands, nano adds shell variables, micro
+// adds redirection, globbing and command timing/tracing.
+#define SHELL_LEVEL_PICO 1
+#define SHELL_LEVEL_NANO 2
+#define SHELL_LEVEL_MICRO 3
+
+#ifndef SHELL_LEVEL
+#define SHELL_LEVEL SHELL_LEVEL_MICRO
+#endif
+
+// <linux/limits.h>, pulled in by the terminal and directory headers, has its
+// own MAX_INPUT; include this header after the system headers.
+#undef MAX_INPUT
+#define MAX_INPUT 256
+#define MAX_ARGS 64
+#define DELIMITERS " \t\r\n"
+
+// Structure to store shell variables
+typedef struct {
+    char* name;
+    char* value;
+} ShellVar;
+
+// Where "2>&1" came relative to a ">": after it (or with none) stderr follows
+// stdout to the file; before it, stderr keeps the stdout the command started
+// with. Redirections are applied in the order the words came in.
+#define ERROR_TO_OUTPUT_AFTER 1
+#define ERROR_TO_OUTPUT_BEFORE 2
+
+// Structure to hold redirection information
+typedef struct {
+    char* input_file;
+    char* output_file;
+    char* error_file;
+    int append_output;   // ">>" instead of ">"
+    int append_error;    // "2>>" instead of "2>"
+    int error_to_output; // "2>&1": ERROR_TO_OUTPUT_AFTER or _BEFORE a ">", 0 when none
+    char* here_delimiter; // "<<WORD": a body is still to be read, up to WORD
+    int here_strip_tabs;  // "<<-WORD": leading tabs of body lines are removed
+    char* here_body;      // here-document or "<<<" here-string fed to stdin
+    size_t here_length;
+} RedirectionInfo;
+
+// Shell fds saved while a command runs in-process with its redirections applied
+typedef struct {
+    int saved[3]; // copies of fds 0-2, -1 when that fd is not redirected
+} SavedFds;
+
+// Timing and resource usage of one command, for `time` and the trace log
+typedef struct {
+    struct timespec start;
+    struct rusage self_start;     // shell's own usage when the command started
+    struct rusage children_start; // usage of reaped children when it started
+    pid_t pid;                    // external command's pid, 0 when run in-process
+    double spawn_us;              // fork until the child's exec succeeded
+    double wall_us;
+    double user_us;
+    double sys_us;
+    long maxrss_kb;
+} CommandStats;
+
+// Growable NUL-terminated string
+typedef struct {
+    char* data;
+    size_t length;
+    size_t capacity;
+} StringBuffer;
+
+// A builtin gets the command's argv and returns its exit status
+typedef int (*BuiltinFn)(char** argv, int argc);
+
+// The builtin only prints: it changes no shell state, so command substitution
+// can run it in-process with its output captured
+#define BUILTIN_PURE 1
+
+// Slot of the builtin table that gen_builtins generates into shell_builtins.h
+typedef struct {
+    const char* name;
+    BuiltinFn fn;
+    int flags;
+} BuiltinSlot;
+
+// FNV-1a, seeded. gen_builtins picks the seed that makes it a perfect hash of
+// the builtin names, so dispatch is one hash and one strcmp. The table is
+// indexed by the low bits, which plain FNV only mixes with lower bits, hence
+// the final shift.
+static inline uint32_t builtin_hash(const char* name, uint32_t seed) {
+    uint32_t hash = 2166136261u ^ seed;
+    for (const unsigned char* p = (const unsigned char*)name; *p != '\0'; p++) {
+        hash = (hash ^ *p) * 16777619u;
+    }
+    return hash ^ (hash >> 16);
+}
+
+// Global array to store shell variables
+extern ShellVar* shellVars;
+extern int numShellVars;
+
+// The shell's environment, owned once export or unset first changed it; NULL
+// until then. environ points at it.
+extern char** environ;
+extern char** shell_envp;
+extern int num_env;
+extern int max_env;
+
+// Logical working directory kept by cd, and the one before it (cd -); NULL
+// until first needed
+extern char* shell_pwd;
+extern char* shell_oldpwd;
+
+// Exit status of the last command, exposed as $?
+extern int last_exit_status;
+
+// Set by --bench-parse: $(...), backticks and glob patterns are kept
+// literally, so substituting and parsing a corpus never runs a command or
+// reads a directory
+extern int parse_only;
+
+// Set while an in-process command runs with fd 0 redirected. The stdin FILE
+// may still hold read-ahead shell input, so such commands read fd 0 directly.
+extern int stdin_redirected;
+
+// Redirections of the builtin being run, NULL outside one; cache keys on the
+// here-document text it was given
+extern RedirectionInfo* builtin_redirections;
+
+// Reads one more input line for a here-document body into *line (getline
+// style, without the newline); -1 at end of input. Reads stdin by default;
+// the micro shell points it at its line editor on a terminal.
+extern ssize_t (*read_continuation_line)(char** line, size_t* capacity);
+
+// JSON-lines trace destination, -1 when tracing is off
+extern int trace_fd;
+
+// Stats of the command being measured, NULL when neither `time` nor the trace
+// is active, so the plain launch path stays unchanged
+extern CommandStats* active_stats;
+
+// Line processing
+void shell_execute_line(char* input);
+char** parse_input(char* input, int* argc, RedirectionInfo* redir_info);
+void add_argument(char*** argv, int* argc, int* capacity, char* arg);
+void free_arguments(char** argv, int argc);
+void free_redirection_info(RedirectionInfo* redir_info);
+
+// Command execution
+const BuiltinSlot* find_builtin(const char* name);
+const char* next_builtin_name(int* slot);
+void dispatch_command(char** argv, int argc, RedirectionInfo* redir_info);
+int execute_builtin(char** argv, int argc, RedirectionInfo* redir_info);
+int execute_utility(char** argv, int argc, RedirectionInfo* redir_info);
+void execute_command(char** argv, int argc, RedirectionInfo* redir_info);
+void redirect_error_to_output(int* saved);
+void run_child(char** argv, RedirectionInfo* redir_info);
+int error_to_output_in_process(SavedFds* saved);
+int redirect_in_process(RedirectionInfo* redir_info, SavedFds* saved);
+void restore_redirections(SavedFds* saved);
+
+// Here-documents
+void set_here_word(const char* word, int mode, RedirectionInfo* redir_info);
+ssize_t read_stdin_line(char** line, size_t* capacity);
+void read_here_document(RedirectionInfo* redir_info);
+int open_here_document(const char* body, size_t length);
+
+// Shell variables
+void add_shell_var(const char* name, const char* value);
+char* get_shell_var(const char* name);
+void free_shell_vars();
+void buffer_append(StringBuffer* buffer, const char* text, size_t len);
+void expand_variables(char* input, StringBuffer* out);
+char* substitute_variables(char* input);
+char* substitute_line(char* input);
+int is_valid_assignment(const char* input);
+int export_variable(const char* name);
+void remove_shell_var(const char* name);
+int is_assignment_word(const char* word);
+int env_find(char** envp, int count, const char* name, size_t name_len);
+int env_count();
+void env_own();
+void env_set(const char* name, const char* value);
+void env_unset(const char* name);
+char** env_overlay(char** assignments, int num_assignments);
+
+// Working directory
+char* physical_cwd();
+int is_same_dir(const char* path, const char* other);
+char* canonicalize_logical(const char* base, const char* path);
+const char* logical_pwd();
+void set_pwd(char* path);
+int change_directory(const char* dir);
+int cd_target(const char* dir);
+
+// Command substitution
+char* find_closing_paren(char* body);
+void capture_command(char* command, StringBuffer* out);
+char* capture_builtin(const BuiltinSlot* builtin, char** argv, int argc, size_t* length);
+char* capture_child(char** argv, int argc, RedirectionInfo* redir_info, size_t* length);
+
+// Command timing
+void stats_begin(CommandStats* stats);
+void stats_end(CommandStats* stats);
+void trace_command(CommandStats* stats, char** argv, int argc);
+
+// I/O helpers
+int write_full(int fd, const void* buf, size_t len);
+int read_full(int fd, void* buf, size_t len);
+
+// Builtins listed in shell_builtins.def
+int builtin_exit(char** argv, int argc);
+int builtin_echo(char** argv, int argc);
+int builtin_pwd(char** argv, int argc);
+int builtin_cd(char** argv, int argc);
+int builtin_pushd(char** argv, int argc);
+int builtin_popd(char** argv, int argc);
+int builtin_dirs(char** argv, int argc);
+int builtin_export(char** argv, int argc);
+int builtin_printenv(char** argv, int argc);
+int builtin_unset(char** argv, int argc);
+int builtin_time(char** argv, int argc);
+int builtin_trace(char** argv, int argc);
+int builtin_parallel(char** argv, int argc); // micro_shell.c
+int builtin_cache(char** argv, int argc);    // micro_shell.c
+
+#endif
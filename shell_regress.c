@@ -0,0 +1,627 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pty.h>
+#include <signal.h>
+#include <time.h>
+#include <termios.h>
+#include <ftw.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+// End-to-end regression check for the shells: runs a scripted session of
+// builtins (100000 commands by default) through a pseudo-terminal or through
+// piped stdin, and reports commands/sec, prompt-to-prompt latency
+// percentiles (pty only) and RSS over time. Exits with 1 when a limit is
+// broken, so `make regress` fails on a regression.
+//
+//   shell_regress [-m pty|pipe|check] [-s femto|pico|nano|micro] [-n COMMANDS]
+//                 [-p PROMPT] [-r MIN_RATE] [-l MAX_P99_US] [-g MAX_RSS_KB] SHELL
+//
+// -m check instead runs the micro shell's scripted cases, each in a fresh
+// shell inside a fresh scratch directory, and compares the output exactly.
+//
+// RSS growth is measured from the end of the first tenth of the session, after
+// buffers have reached their working size, to the end. The micro shell's
+// history is turned off (empty MICRO_SHELL_HISTFILE) since it grows with every
+// command by design.
+
+#define REGRESS_DEFAULT_COMMANDS 100000
+#define REGRESS_RSS_SAMPLES 10
+#define REGRESS_TIMEOUT_MS 10000
+#define REGRESS_TAIL 256
+
+// Commands of each session, cycled. Builtins only, so what is measured is the
+// shell itself and not fork+exec of external programs. No output may contain
+// the prompt.
+const char* femto_commands[] = {
+    "echo hello", "echo a b c d e f g h", "unknown", NULL
+};
+const char* pico_commands[] = {
+    "echo hello", "pwd", "cd /tmp", "echo a b c d e f g h", "cd /", "pwd", NULL
+};
+const char* nano_commands[] = {
+    "echo hello", "X=abc", "Y=$X$X$X", "echo $X $Y", "cd /tmp", "pwd", "export X", "A=1 B=2",
+    "X=1 echo $X", "unset Y", "echo $A $B $?", "cd /", NULL
+};
+const char* micro_commands[] = {
+    "echo hello", "X=abc", "Y=$X$X$X", "echo $X $Y", "echo $(pwd) `echo sub`", "pushd /tmp",
+    "dirs", "popd", "echo hi > /dev/null", "echo < /dev/null", "echo <<< here", "X=$(echo -n new)",
+    "export X", "A=1 B=2", "X=1 echo $X", "unset Y", "echo -e a\\tb $?", "cd /", NULL
+};
+
+typedef struct {
+    const char* mode;
+    const char* level;
+    const char* prompt;
+    const char* shell;
+    long commands;
+    double min_rate;
+    double max_p99_us;
+    long max_rss_growth_kb;
+} RegressOptions;
+
+double now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+// VmRSS of pid in KB, -1 when it cannot be read
+long read_rss_kb(pid_t pid) {
+    char path[64];
+    char line[256];
+    long rss = -1;
+    snprintf(path, sizeof(path), "/proc/%d/status", (int)pid);
+    FILE* status = fopen(path, "r");
+    if (status == NULL) {
+        return -1;
+    }
+    while (fgets(line, sizeof(line), status) != NULL) {
+        if (strncmp(line, "VmRSS:", 6) == 0) {
+            rss = strtol(line + 6, NULL, 10);
+            break;
+        }
+    }
+    fclose(status);
+    return rss;
+}
+
+// Scheduler state of pid ('R' running, 'S' sleeping, ...), '?' when unknown
+char process_state(pid_t pid) {
+    char path[64];
+    char stat[512];
+    snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return '?';
+    }
+    ssize_t n = read(fd, stat, sizeof(stat) - 1);
+    close(fd);
+    if (n <= 0) {
+        return '?';
+    }
+    stat[n] = '\0';
+    // The command name in parentheses may hold spaces; the state follows it
+    char* paren = strrchr(stat, ')');
+    return (paren != NULL && paren[1] == ' ') ? paren[2] : '?';
+}
+
+int write_all(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Reads pty output until the shell prints its prompt again: the output ends
+// with the prompt and a newline (the command's Enter) came before it. The
+// micro shell redraws "prompt + line" on every key, so a prompt alone is not
+// enough. Returns -1 on EOF or timeout.
+int wait_for_prompt(int fd, const char* prompt, int need_newline) {
+    char tail[REGRESS_TAIL + 1];
+    size_t tail_len = 0;
+    size_t prompt_len = strlen(prompt);
+    int seen_newline = !need_newline;
+    char buffer[4096];
+    while (1) {
+        struct pollfd pfd = {fd, POLLIN, 0};
+        int ready = poll(&pfd, 1, REGRESS_TIMEOUT_MS);
+        if (ready == -1 && errno == EINTR) {
+            continue;
+        }
+        if (ready <= 0) {
+            fprintf(stderr, "shell_regress: no prompt within %d ms\n", REGRESS_TIMEOUT_MS);
+            return -1;
+        }
+        ssize_t n = read(fd, buffer, sizeof(buffer));
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            fprintf(stderr, "shell_regress: shell exited\n");
+            return -1;
+        }
+        if (memchr(buffer, '\n', n) != NULL) {
+            seen_newline = 1;
+        }
+        // Keep the last REGRESS_TAIL bytes of output
+        if ((size_t)n >= REGRESS_TAIL) {
+            memcpy(tail, buffer + n - REGRESS_TAIL, REGRESS_TAIL);
+            tail_len = REGRESS_TAIL;
+        } else {
+            if (tail_len + n > REGRESS_TAIL) {
+                size_t drop = tail_len + n - REGRESS_TAIL;
+                memmove(tail, tail + drop, tail_len - drop);
+                tail_len -= drop;
+            }
+            memcpy(tail + tail_len, buffer, n);
+            tail_len += n;
+        }
+        if (seen_newline && tail_len >= prompt_len &&
+            memcmp(tail + tail_len - prompt_len, prompt, prompt_len) == 0) {
+            return 0;
+        }
+    }
+}
+
+void print_rss(const long* rss, int count) {
+    printf("  rss KB:");
+    for (int i = 0; i < count; i++) {
+        printf(" %ld", rss[i]);
+    }
+    printf("\n");
+}
+
+// Compares the results with the limits; returns 1 when one is broken
+int check_limits(const RegressOptions* options, double rate, double p99_us, long rss_growth_kb) {
+    int failed = 0;
+    if (options->min_rate > 0 && rate < options->min_rate) {
+        printf("  FAIL: %.0f commands/sec is below %.0f\n", rate, options->min_rate);
+        failed = 1;
+    }
+    if (options->max_p99_us > 0 && p99_us > options->max_p99_us) {
+        printf("  FAIL: p99 latency %.1f us is above %.1f us\n", p99_us, options->max_p99_us);
+        failed = 1;
+    }
+    if (options->max_rss_growth_kb >= 0 && rss_growth_kb > options->max_rss_growth_kb) {
+        printf("  FAIL: RSS grew by %ld KB, more than %ld KB\n", rss_growth_kb, options->max_rss_growth_kb);
+        failed = 1;
+    }
+    return failed;
+}
+
+// Starts the shell with the given stdin/stdout, in dir unless NULL; history off
+// for the micro shell
+pid_t spawn_shell(const RegressOptions* options, int in_fd, int out_fd, const char* dir) {
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork failed");
+    } else if (pid == 0) {
+        if (dup2(in_fd, 0) == -1 || dup2(out_fd, 1) == -1 || dup2(out_fd, 2) == -1) {
+            perror("dup2 failed");
+            _exit(127);
+        }
+        if (dir != NULL && chdir(dir) == -1) {
+            perror("chdir failed");
+            _exit(127);
+        }
+        setenv("MICRO_SHELL_HISTFILE", "", 1);
+        execl(options->shell, options->shell, (char*)NULL);
+        perror("exec shell failed");
+        _exit(127);
+    }
+    return pid;
+}
+
+// One command per write, each sent once the previous prompt appeared, so
+// every command's prompt-to-prompt latency is measured
+int run_pty(const RegressOptions* options, const char** commands, int num_commands) {
+    int master;
+    pid_t pid = forkpty(&master, NULL, NULL, NULL);
+    if (pid == -1) {
+        perror("forkpty failed");
+        return 2;
+    } else if (pid == 0) {
+        setenv("MICRO_SHELL_HISTFILE", "", 1);
+        execl(options->shell, options->shell, (char*)NULL);
+        perror("exec shell failed");
+        _exit(127);
+    }
+
+    double* latencies = (double*)malloc(sizeof(double) * options->commands);
+    if (latencies == NULL) {
+        perror("malloc failed");
+        exit(EXIT_FAILURE);
+    }
+    long rss[REGRESS_RSS_SAMPLES];
+    long sample_every = options->commands / REGRESS_RSS_SAMPLES;
+    int num_rss = 0;
+    int result = 2;
+    if (wait_for_prompt(master, options->prompt, 0) == 0) {
+        double start = now_us();
+        long i;
+        for (i = 0; i < options->commands; i++) {
+            char line[256];
+            int len = snprintf(line, sizeof(line), "%s\n", commands[i % num_commands]);
+            double sent = now_us();
+            if (write_all(master, line, len) == -1 || wait_for_prompt(master, options->prompt, 1) == -1) {
+                fprintf(stderr, "shell_regress: stopped at command %ld (%s)\n", i, commands[i % num_commands]);
+                break;
+            }
+            latencies[i] = now_us() - sent;
+            if (sample_every > 0 && (i + 1) % sample_every == 0 && num_rss < REGRESS_RSS_SAMPLES) {
+                rss[num_rss++] = read_rss_kb(pid);
+            }
+        }
+        double elapsed = now_us() - start;
+        if (i == options->commands) {
+            qsort(latencies, options->commands, sizeof(double), compare_doubles);
+            double rate = options->commands / (elapsed / 1e6);
+            double p50 = latencies[options->commands / 2];
+            double p90 = latencies[options->commands * 9 / 10];
+            double p99 = latencies[options->commands * 99 / 100];
+            long growth = (num_rss >= 2) ? rss[num_rss - 1] - rss[0] : 0;
+            printf("%s (pty, %s): %ld commands, %.0f commands/sec\n", options->shell, options->level,
+                   options->commands, rate);
+            printf("  latency us: p50 %.1f  p90 %.1f  p99 %.1f  max %.1f\n", p50, p90, p99,
+                   latencies[options->commands - 1]);
+            print_rss(rss, num_rss);
+            printf("  rss growth after warm-up: %ld KB\n", growth);
+            result = check_limits(options, rate, p99, growth);
+        }
+    }
+    free(latencies);
+    write_all(master, "exit\n", 5);
+    close(master);
+    kill(pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+    return result;
+}
+
+// Waits until the shell has read all of its piped input and is blocked
+// waiting for more. The last lines may still sit in its stdio buffer, a few
+// KB at most.
+int wait_for_idle(pid_t pid, int in_fd) {
+    double deadline = now_us() + REGRESS_TIMEOUT_MS * 1e3;
+    int idle = 0;
+    while (idle < 3) {
+        int pending = 0;
+        if (ioctl(in_fd, FIONREAD, &pending) == -1) {
+            pending = 0;
+        }
+        idle = (pending == 0 && process_state(pid) == 'S') ? idle + 1 : 0;
+        if (now_us() > deadline) {
+            fprintf(stderr, "shell_regress: shell still busy after %d ms\n", REGRESS_TIMEOUT_MS);
+            return -1;
+        }
+        usleep(1000);
+    }
+    return 0;
+}
+
+// The whole script streamed through a pipe, as from `shell < script`; output
+// goes to /dev/null. Throughput and RSS only: without a terminal the shells
+// don't flush their prompts, so there is no per-command latency.
+int run_pipe(const RegressOptions* options, const char** commands, int num_commands) {
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) == -1) {
+        perror("pipe failed");
+        return 2;
+    }
+    int null_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    if (null_fd == -1) {
+        perror("open /dev/null failed");
+        return 2;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    double start = now_us();
+    pid_t pid = spawn_shell(options, fds[0], null_fd, NULL);
+    close(fds[0]);
+    close(null_fd);
+    if (pid == -1) {
+        close(fds[1]);
+        return 2;
+    }
+
+    long rss[REGRESS_RSS_SAMPLES];
+    long sample_every = options->commands / REGRESS_RSS_SAMPLES;
+    int num_rss = 0;
+    int result = 2;
+    char chunk[8192];
+    size_t used = 0;
+    long i;
+    for (i = 0; i < options->commands; i++) {
+        const char* command = commands[i % num_commands];
+        size_t len = strlen(command);
+        if (used + len + 1 > sizeof(chunk)) {
+            if (write_all(fds[1], chunk, used) == -1) {
+                break;
+            }
+            used = 0;
+        }
+        memcpy(chunk + used, command, len);
+        chunk[used + len] = '\n';
+        used += len + 1;
+        // Sampled once the shell caught up with everything sent so far
+        if (sample_every > 0 && (i + 1) % sample_every == 0 && num_rss < REGRESS_RSS_SAMPLES) {
+            if (write_all(fds[1], chunk, used) == -1 || wait_for_idle(pid, fds[1]) == -1) {
+                break;
+            }
+            used = 0;
+            rss[num_rss++] = read_rss_kb(pid);
+        }
+    }
+    if (i == options->commands && write_all(fds[1], chunk, used) == 0 && wait_for_idle(pid, fds[1]) == 0) {
+        double elapsed = now_us() - start;
+        double rate = options->commands / (elapsed / 1e6);
+        long growth = (num_rss >= 2) ? rss[num_rss - 1] - rss[0] : 0;
+        printf("%s (pipe, %s): %ld commands, %.0f commands/sec\n", options->shell, options->level,
+               options->commands, rate);
+        print_rss(rss, num_rss);
+        printf("  rss growth after warm-up: %ld KB\n", growth);
+        result = check_limits(options, rate, 0, growth);
+    } else {
+        fprintf(stderr, "shell_regress: shell stopped reading at command %ld\n", i);
+    }
+    write_all(fds[1], "exit\n", 5);
+    close(fds[1]);
+    int status;
+    waitpid(pid, &status, 0);
+    return result;
+}
+
+// Cases for -m check: commands (one per line) and their exact output, stdout
+// and stderr, run in a scratch directory made by make_fixture
+typedef struct {
+    const char* command;
+    const char* expected;
+} RegressCase;
+
+const RegressCase micro_cases[] = {
+    // Globs: a final "**" lists everything below, never "." or the base dir
+    {"echo **", "cache d1 d1/sub d1/sub/deep.log d1/x.log d2\n"},
+    {"echo d1/**", "d1/sub d1/sub/deep.log d1/x.log\n"},
+    {"echo **/*.log", "d1/sub/deep.log d1/x.log\n"},
+    // A trailing '/' matches directories only
+    {"echo d1/*/", "d1/sub/\n"},
+    {"echo */", "cache/ d1/ d2/\n"},
+    {"echo **/", "cache/ d1/ d1/sub/ d2/\n"},
+    // No match: the word itself, escapes removed
+    {"echo \\*.log", "*.log\n"},
+    {"echo d1/\\*/n*", "d1/*/n*\n"},
+    // cache keys on the input: a changed file, a here-string, /dev/null
+    {"MICRO_SHELL_CACHE_DIR=.store\nexport MICRO_SHELL_CACHE_DIR\necho one > in\ncache sort < in\necho two > in\ncache sort < in",
+     "one\ntwo\n"},
+    {"MICRO_SHELL_CACHE_DIR=.store\nexport MICRO_SHELL_CACHE_DIR\ncache cat <<< one\ncache cat <<< two\ncache cat < /dev/null",
+     "one\ntwo\n"},
+    // parallel rejects a -j that is not a positive number
+    {"parallel -j 0 echo ::: a\necho $?\nparallel -j 2x echo ::: a",
+     "parallel: -j takes a positive number of jobs, not '0'\n1\n"
+     "parallel: -j takes a positive number of jobs, not '2x'\n"},
+    // export fails with the wrong number of arguments or an unknown name
+    {"export\necho $?\nexport NO_SUCH_VAR\necho $?\nX=1\nexport X\necho $?",
+     "export: invalid number of arguments\n1\nexport: variable not found\n1\n0\n"},
+    // Redirections apply left to right: 2>&1 before > keeps the old stdout
+    {"export 2>&1 > out\necho ---\ncat out", "export: invalid number of arguments\n---\n"},
+    {"export > out 2>&1\necho ---\ncat out", "---\nexport: invalid number of arguments\n"},
+    {"export 2>&1 2> err\necho ---\ncat err", "---\nexport: invalid number of arguments\n"},
+    {NULL, NULL}
+};
+
+// Scratch tree: cache/ d1/x.log d1/sub/deep.log d2/
+int make_fixture(char* dir) {
+    const char* dirs[] = {"cache", "d1", "d1/sub", "d2", NULL};
+    const char* files[] = {"d1/x.log", "d1/sub/deep.log", NULL};
+    char path[4096];
+    if (mkdtemp(dir) == NULL) {
+        perror("mkdtemp failed");
+        return -1;
+    }
+    for (int i = 0; dirs[i] != NULL; i++) {
+        snprintf(path, sizeof(path), "%s/%s", dir, dirs[i]);
+        if (mkdir(path, 0755) == -1) {
+            perror("mkdir failed");
+            return -1;
+        }
+    }
+    for (int i = 0; files[i] != NULL; i++) {
+        snprintf(path, sizeof(path), "%s/%s", dir, files[i]);
+        int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd == -1) {
+            perror("open failed");
+            return -1;
+        }
+        close(fd);
+    }
+    return 0;
+}
+
+int remove_entry(const char* path, const struct stat* st, int type, struct FTW* ftw) {
+    remove(path);
+    return 0;
+}
+
+// Runs commands in a fresh shell reading a pipe; the output is what the shell
+// wrote between its first and last prompt, prompts removed. Returns a
+// malloc'd string, or NULL when the shell failed to run.
+char* run_case(const RegressOptions* options, const char* dir, const char* command) {
+    int in_fds[2], out_fds[2];
+    if (pipe2(in_fds, O_CLOEXEC) == -1 || pipe2(out_fds, O_CLOEXEC) == -1) {
+        perror("pipe failed");
+        return NULL;
+    }
+    pid_t pid = spawn_shell(options, in_fds[0], out_fds[1], dir);
+    close(in_fds[0]);
+    close(out_fds[1]);
+    if (pid != -1) {
+        // The shell exits at end of input
+        write_all(in_fds[1], command, strlen(command));
+        write_all(in_fds[1], "\n", 1);
+    }
+    close(in_fds[1]);
+
+    size_t used = 0;
+    size_t capacity = 4096;
+    char* output = (char*)malloc(capacity + 1);
+    if (output == NULL) {
+        perror("malloc failed");
+        exit(EXIT_FAILURE);
+    }
+    ssize_t n;
+    while ((n = read(out_fds[0], output + used, capacity - used)) != 0) {
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        used += n;
+        if (used == capacity) {
+            capacity *= 2;
+            char* new_output = (char*)realloc(output, capacity + 1);
+            if (new_output == NULL) {
+                perror("realloc failed");
+                exit(EXIT_FAILURE);
+            }
+            output = new_output;
+        }
+    }
+    output[used] = '\0';
+    close(out_fds[0]);
+    if (pid == -1) {
+        free(output);
+        return NULL;
+    }
+    waitpid(pid, NULL, 0);
+
+    char* start = strstr(output, options->prompt);
+    if (start == NULL) {
+        free(output);
+        return NULL;
+    }
+    size_t prompt_len = strlen(options->prompt);
+    char* out = output;
+    start += prompt_len;
+    for (char* end; (end = strstr(start, options->prompt)) != NULL; start = end + prompt_len) {
+        memmove(out, start, end - start);
+        out += end - start;
+    }
+    *out = '\0';
+    return output;
+}
+
+int run_check(const RegressOptions* options) {
+    // The cases run in the scratch directory, so a relative SHELL is resolved first
+    RegressOptions in_fixture = *options;
+    char* shell = realpath(options->shell, NULL);
+    if (shell == NULL) {
+        perror(options->shell);
+        return 2;
+    }
+    in_fixture.shell = shell;
+    signal(SIGPIPE, SIG_IGN);
+    int failed = 0;
+    int count = 0;
+    for (const RegressCase* c = micro_cases; c->command != NULL; c++, count++) {
+        char dir[] = "/tmp/shell_regress.XXXXXX";
+        if (make_fixture(dir) == -1) {
+            free(shell);
+            return 2;
+        }
+        char* output = run_case(&in_fixture, dir, c->command);
+        if (output == NULL || strcmp(output, c->expected) != 0) {
+            printf("  FAIL: %s\n    expected: %s    got:      %s%s", c->command, c->expected,
+                   output != NULL ? output : "(no output)\n",
+                   (output != NULL && strchr(output, '\n') == NULL) ? "\n" : "");
+            failed++;
+        }
+        free(output);
+        nftw(dir, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+    }
+    free(shell);
+    printf("%s (check): %d of %d cases passed\n", options->shell, count - failed, count);
+    return failed > 0;
+}
+
+void usage() {
+    fprintf(stderr, "usage: shell_regress [-m pty|pipe|check] [-s femto|pico|nano|micro] [-n COMMANDS] [-p PROMPT]\n"
+                    "                     [-r MIN_RATE] [-l MAX_P99_US] [-g MAX_RSS_KB] SHELL\n");
+    exit(2);
+}
+
+int main(int argc, char* argv[]) {
+    RegressOptions options = {"pty", "micro", NULL, NULL, REGRESS_DEFAULT_COMMANDS, 0, 0, -1};
+    int opt;
+    while ((opt = getopt(argc, argv, "m:s:n:p:r:l:g:")) != -1) {
+        switch (opt) {
+        case 'm': options.mode = optarg; break;
+        case 's': options.level = optarg; break;
+        case 'n': options.commands = atol(optarg); break;
+        case 'p': options.prompt = optarg; break;
+        case 'r': options.min_rate = atof(optarg); break;
+        case 'l': options.max_p99_us = atof(optarg); break;
+        case 'g': options.max_rss_growth_kb = atol(optarg); break;
+        default: usage();
+        }
+    }
+    if (optind != argc - 1 || options.commands < REGRESS_RSS_SAMPLES) {
+        usage();
+    }
+    options.shell = argv[optind];
+
+    const char** commands;
+    const char* default_prompt;
+    if (strcmp(options.level, "femto") == 0) {
+        commands = femto_commands;
+        default_prompt = "MiniShell > ";
+    } else if (strcmp(options.level, "pico") == 0) {
+        commands = pico_commands;
+        default_prompt = "PicoShell > ";
+    } else if (strcmp(options.level, "nano") == 0) {
+        commands = nano_commands;
+        default_prompt = "Nano Shell Prompt > ";
+    } else if (strcmp(options.level, "micro") == 0) {
+        commands = micro_commands;
+        default_prompt = "Nano Shell Prompt > ";
+    } else {
+        usage();
+    }
+    if (options.prompt == NULL) {
+        options.prompt = default_prompt;
+    }
+    int num_commands = 0;
+    while (commands[num_commands] != NULL) {
+        num_commands++;
+    }
+
+    if (strcmp(options.mode, "pty") == 0) {
+        return run_pty(&options, commands, num_commands);
+    } else if (strcmp(options.mode, "pipe") == 0) {
+        return run_pipe(&options, commands, num_commands);
+    } else if (strcmp(options.mode, "check") == 0) {
+        return run_check(&options);
+    }
+    usage();
+    return 2;
+}